@@ -1,4 +1,8 @@
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <span>
+#include <vector>
 using namespace std;
 /*
 BUILDER PATTERN:
@@ -29,11 +33,14 @@ class ParentObject {
         void setattrC(int C) {
             attrC = C;
         }
+        int total() const {
+            return attrA + attrB + attrC;
+        }
         virtual ~ParentObject() = default;
     private:
-        int attrA;
-        int attrB;
-        int attrC;
+        int attrA = 0;
+        int attrB = 0;
+        int attrC = 0;
 };
 
 /* Abstract Builder Class*/
@@ -44,10 +51,12 @@ class Builder {
         void buildPartC() {};
         // any derived builder must overwrite this method
         virtual ParentObject* buildObject() = 0;
+        // the same parts, set on an object that already exists
+        virtual void buildInto(ParentObject& target) = 0;
 };
 
-/* Object 1 Builder Class*/
-class Object1Builder : public Builder {
+/* Object 1 Builder Class, final so calls through the concrete type need no vtable*/
+class Object1Builder final : public Builder {
     public:
         void buildPartA() {
             obj->setattrA(1);
@@ -65,12 +74,18 @@ class Object1Builder : public Builder {
             buildPartC();
             return obj;
         }
+        virtual void buildInto(ParentObject& target) {
+            obj = &target;
+            buildPartA();
+            buildPartB();
+            buildPartC();
+        }
     private:
         ParentObject* obj;
 };
 
-/* Object 2 Builder Class*/
-class Object2Builder : public Builder {
+/* Object 2 Builder Class, final so calls through the concrete type need no vtable*/
+class Object2Builder final : public Builder {
     public:
         void buildPartA() {
             obj->setattrA(4);
@@ -88,6 +103,12 @@ class Object2Builder : public Builder {
             buildPartC();
             return obj;
         }
+        virtual void buildInto(ParentObject& target) {
+            obj = &target;
+            buildPartA();
+            buildPartB();
+            buildPartC();
+        }
     private:
         ParentObject* obj;
 };
@@ -105,10 +126,54 @@ class Director {
         ParentObject* build() {
             return builder->buildObject();
         }
+        // constructs n products in raw, uninitialized storage with room for them (a buffer, an arena)
+        // and builds each where it stands, one virtual call per product, no allocation.
+        // The caller destroys them, std::destroy(products.begin(), products.end())
+        span<ParentObject> buildMany(size_t n, ParentObject* raw) {
+            return buildEach(n, raw, [this](ParentObject& obj) { builder->buildInto(obj); });
+        }
+        // n products by value, side by side in one vector
+        vector<ParentObject> buildMany(size_t n) {
+            vector<ParentObject> out;
+            out.reserve(n);
+            for (size_t i = 0; i < n; ++i) builder->buildInto(out.emplace_back());
+            return out;
+        }
+        // when the concrete builder is known the steps are direct calls the compiler can inline
+        template <class ConcreteBuilder>
+        static span<ParentObject> buildMany(ConcreteBuilder& b, size_t n, ParentObject* raw) {
+            return buildEach(n, raw, [&b](ParentObject& obj) { b.ConcreteBuilder::buildInto(obj); });
+        }
     private:
+        // if a build throws, the products already made are destroyed and raw is left as it came
+        template <class Build>
+        static span<ParentObject> buildEach(size_t n, ParentObject* raw, Build build) {
+            size_t made = 0;
+            try {
+                while (made < n) {
+                    ParentObject& obj = *construct_at(raw + made);
+                    ++made;
+                    build(obj);
+                }
+            } catch (...) {
+                destroy_n(raw, made);
+                throw;
+            }
+            return span<ParentObject>(raw, n);
+        }
         Builder* builder;
 };
 
+// ns per product for build(n) building n products and then reading them all
+template <class Build>
+double benchmark(size_t n, Build build) {
+    auto start = chrono::steady_clock::now();
+    long sum = build(n);
+    chrono::duration<double, nano> ns = chrono::steady_clock::now() - start;
+    if (sum != long(6 * n)) cout << "wrong checksum " << sum << endl;
+    return ns.count() / n;
+}
+
 int main()  {
     Object1Builder b1;
     Object2Builder b2;
@@ -120,5 +185,35 @@ int main()  {
     obj2->spec();
     delete obj1;
     delete obj2;
-    
+
+    // one new per product against building into contiguous storage
+    const size_t n = 10000000;
+    d.setBuilder(&b1);
+    double heap = benchmark(n, [&](size_t n) {
+        vector<ParentObject*> products(n);
+        for (ParentObject*& p : products) p = d.build();
+        long sum = 0;
+        for (ParentObject* p : products) sum += p->total();
+        for (ParentObject* p : products) delete p;
+        return sum;
+    });
+    double virt = benchmark(n, [&](size_t n) {
+        vector<ParentObject> products = d.buildMany(n);
+        long sum = 0;
+        for (const ParentObject& p : products) sum += p.total();
+        return sum;
+    });
+    // raw storage, as an arena would hand out
+    allocator<ParentObject> storage;
+    double direct = benchmark(n, [&](size_t n) {
+        ParentObject* raw = storage.allocate(n);
+        span<ParentObject> products = Director::buildMany(b1, n, raw);
+        long sum = 0;
+        for (const ParentObject& p : products) sum += p.total();
+        destroy(products.begin(), products.end());
+        storage.deallocate(raw, n);
+        return sum;
+    });
+    cout << "new per product " << heap << " ns, buildMany " << virt << " ns, buildMany with Object1Builder "
+         << direct << " ns" << endl;
 }
\ No newline at end of file
@@ -1,31 +1,212 @@
 /*
- * The decorator pattern can be thought of as a wrapper 
+ * The decorator pattern can be thought of as a wrapper
  * or more formally a way to enhance or extend the behavior of an object dynamically.
  * The pattern provides an alternative to subclassing when new functionality is desired.
  */
-#include<vector>
+#include<bitset>
+#include<chrono>
+#include<cstdint>
 #include<iostream>
+#include<memory>
+#include<mutex>
+#include<stdexcept>
 #include<string>
+#include<unordered_map>
+#include<vector>
+
+using ComponentId = uint8_t;
+constexpr size_t maxComponents = 64;
+using Components = std::bitset<maxComponents>;
+
+/* Component names interned to small ids, so a pizza keeps its components as bits */
+class ComponentNames {
+    public:
+        static ComponentId intern(const std::string& name) {
+            ComponentNames& names = instance();
+            std::lock_guard<std::mutex> lock(names.guard);
+            auto it = names.ids.find(name);
+            if (it != names.ids.end()) return it->second;
+            if (names.byId.size() == maxComponents) throw std::length_error("too many pizza components");
+            names.byId.push_back(name);
+            return names.ids[name] = ComponentId(names.byId.size() - 1);
+        }
+        static std::string name(ComponentId id) {
+            ComponentNames& names = instance();
+            std::lock_guard<std::mutex> lock(names.guard);
+            return names.byId.at(id);
+        }
+    private:
+        static ComponentNames& instance() {
+            static ComponentNames names;
+            return names;
+        }
+        std::mutex guard;
+        std::unordered_map<std::string, ComponentId> ids;
+        std::vector<std::string> byId;
+};
+
 class Pizza {
     public:
-        virtual double getPrice() = 0;
-        virtual void getDiscription() = 0;
-        virtual ~Pizza(); 
-        void addComponents(std::string comp) {components.push_back(comp);};
+        virtual double getPrice() const = 0;
+        virtual void getDescription() const = 0;
+        virtual ~Pizza() = default;
+        void addComponents(const std::string& comp) {components.set(ComponentNames::intern(comp));}
+        void addComponent(ComponentId id) {components.set(id);}
+        void addComponents(const Components& bits) {components |= bits;}
+        const Components& getComponents() const {return components;}
+        void printComponents() const {
+            for (size_t id = 0; id < maxComponents; ++id) {
+                if (components.test(id)) std::cout << ComponentNames::name(ComponentId(id)) << " ";
+            }
+            std::cout << std::endl;
+        }
     private:
-        std::vector<std::string> components;
+        Components components;
 };
 
+/* Toppings are plain descriptions shared by the runtime and the static decorators */
+#define PIZZA_TOPPING(Type, label, cost)                                          \
+    struct Type {                                                                 \
+        static constexpr const char* name = label;                                \
+        static constexpr double price = cost;                                     \
+        static ComponentId id() {                                                 \
+            static const ComponentId interned = ComponentNames::intern(name);     \
+            return interned;                                                      \
+        }                                                                         \
+    };
+PIZZA_TOPPING(Dough, "Dough", 5.0)
+PIZZA_TOPPING(Cheese, "Cheese", 1.25)
+PIZZA_TOPPING(Pepperoni, "Pepperoni", 1.75)
+PIZZA_TOPPING(Mushroom, "Mushroom", 0.9)
+PIZZA_TOPPING(Olive, "Olive", 0.6)
+PIZZA_TOPPING(Onion, "Onion", 0.4)
+PIZZA_TOPPING(Basil, "Basil", 0.3)
+PIZZA_TOPPING(Ham, "Ham", 1.5)
+#undef PIZZA_TOPPING
 
 class PlainPizza : public Pizza {
     public:
-        PlainPizza() {addComponents("Dough");}
-        virtual void getDIscription() { std::cout << "A plain pizza";};
+        PlainPizza() {addComponent(Dough::id());}
+        virtual double getPrice() const { return Dough::price; }
+        virtual void getDescription() const { std::cout << "A plain pizza";}
+};
+
+// Runtime decorators: each wraps the pizza it decorates and adds to its price and description
+class PizzaDecorator : public Pizza {
+    public:
+        explicit PizzaDecorator(std::unique_ptr<Pizza> inner) : inner(std::move(inner)) {
+            addComponents(this->inner->getComponents());
+        }
+        virtual double getPrice() const { return inner->getPrice(); }
+        virtual void getDescription() const { inner->getDescription(); }
+    private:
+        std::unique_ptr<Pizza> inner;
+};
+
+template <class Topping>
+class With : public PizzaDecorator {
+    public:
+        explicit With(std::unique_ptr<Pizza> inner) : PizzaDecorator(std::move(inner)) {addComponent(Topping::id());}
+        virtual double getPrice() const { return PizzaDecorator::getPrice() + Topping::price; }
+        virtual void getDescription() const {
+            PizzaDecorator::getDescription();
+            std::cout << ", with " << Topping::name;
+        }
+};
 
+/* Static decorators: the stack is a type, so nothing is virtual inside it and
+ * getPrice() inlines into one sum, a constant when the stack is fixed.
+ */
+struct StaticPlain {
+    static constexpr double getPrice() { return Dough::price; }
+    static Components getComponents() { return Components().set(Dough::id()); }
+    static void getDescription() { std::cout << "A plain pizza"; }
 };
 
+template <class Inner, class Topping>
+struct StaticWith {
+    static constexpr double getPrice() { return Inner::getPrice() + Topping::price; }
+    static Components getComponents() { return Inner::getComponents().set(Topping::id()); }
+    static void getDescription() {
+        Inner::getDescription();
+        std::cout << ", with " << Topping::name;
+    }
+};
 
-class PizzaDecorator : public Pizza {
+// StaticPlain with Toppings applied in order
+template <class Inner, class... Toppings>
+struct StackOf {
+    using type = Inner;
+};
+template <class Inner, class Topping, class... Rest>
+struct StackOf<Inner, Topping, Rest...> {
+    using type = typename StackOf<StaticWith<Inner, Topping>, Rest...>::type;
+};
+template <class... Toppings>
+using StaticPizza = typename StackOf<StaticPlain, Toppings...>::type;
 
+// A static stack behind the Pizza interface, one virtual call for the whole stack
+template <class Stack>
+class Flattened final : public Pizza {
+    public:
+        Flattened() {addComponents(Stack::getComponents());}
+        virtual double getPrice() const { return Stack::getPrice(); }
+        virtual void getDescription() const { Stack::getDescription(); }
 };
 
+// ns per order to total the prices of orders
+template <class Orders>
+double benchmark(const Orders& orders, double& total) {
+    auto start = std::chrono::steady_clock::now();
+    total = 0;
+    for (const auto& order : orders) total += order->getPrice();
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+    return ns.count() / orders.size();
+}
+
+// the runtime chain for the same toppings as StaticPizza<Toppings...>
+template <class... Toppings>
+std::unique_ptr<Pizza> chain() {
+    std::unique_ptr<Pizza> pizza = std::make_unique<PlainPizza>();
+    ((pizza = std::make_unique<With<Toppings>>(std::move(pizza))), ...);
+    return pizza;
+}
+
+int main() {
+    std::unique_ptr<Pizza> pizza = chain<Cheese, Mushroom, Olive>();
+    pizza->getDescription();
+    std::cout << ": " << pizza->getPrice() << std::endl;
+    pizza->printComponents();
+    StaticPizza<Cheese, Mushroom, Olive>::getDescription();
+    static_assert(StaticPizza<Cheese, Mushroom, Olive>::getPrice() == Dough::price + Cheese::price + Mushroom::price + Olive::price);
+    std::cout << ": " << StaticPizza<Cheese, Mushroom, Olive>::getPrice() << std::endl;
+
+    // 16 toppings deep, 2M orders of two kinds
+#define DEEP_A Cheese, Pepperoni, Mushroom, Olive, Onion, Basil, Ham, Cheese, Pepperoni, Mushroom, Olive, Onion, Basil, Ham, Cheese, Cheese
+#define DEEP_B Ham, Basil, Onion, Olive, Mushroom, Pepperoni, Cheese, Ham, Basil, Onion, Olive, Mushroom, Pepperoni, Cheese, Olive, Olive
+    const size_t n = 2000000;
+    std::vector<std::unique_ptr<Pizza>> chains, flattened;
+    chains.reserve(n);
+    flattened.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        chains.push_back(i % 2 ? chain<DEEP_B>() : chain<DEEP_A>());
+        flattened.push_back(i % 2 ? std::unique_ptr<Pizza>(new Flattened<StaticPizza<DEEP_B>>())
+                                  : std::unique_ptr<Pizza>(new Flattened<StaticPizza<DEEP_A>>()));
+    }
+    double chainTotal, flatTotal;
+    double chainNs = benchmark(chains, chainTotal);
+    double flatNs = benchmark(flattened, flatTotal);
+    std::vector<bool> kinds(n);
+    for (size_t i = 0; i < n; ++i) kinds[i] = i % 2;
+    auto start = std::chrono::steady_clock::now();
+    double staticTotal = 0;
+    for (bool b : kinds) staticTotal += b ? StaticPizza<DEEP_B>::getPrice() : StaticPizza<DEEP_A>::getPrice();
+    std::chrono::duration<double, std::nano> staticNs = std::chrono::steady_clock::now() - start;
+#undef DEEP_A
+#undef DEEP_B
+    std::cout << "runtime chain " << chainNs << " ns/order, flattened " << flatNs << " ns/order, static "
+              << staticNs.count() / n << " ns/order (totals " << chainTotal << " " << flatTotal << " "
+              << staticTotal << ")" << std::endl;
+    std::cout << "components: " << sizeof(Components) << " bytes of bits, " << sizeof(std::vector<std::string>)
+              << " bytes plus one string per component before" << std::endl;
+}
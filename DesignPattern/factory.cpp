@@ -3,41 +3,66 @@
  * but delegating the actual instantiation of objects to subclasses.
  */
 
+#include<chrono>
+#include<cstdint>
+#include<cstring>
 #include<iostream>
+#include<memory>
+#include<optional>
+#include<random>
+#include<variant>
 #include<vector>
+#include<linux/perf_event.h>
+#include<sys/ioctl.h>
+#include<sys/syscall.h>
+#include<unistd.h>
 
 using namespace std;
 
 class Parent {
     public:
         virtual void info() = 0;
+        virtual int id() const = 0;
         virtual ~Parent() = default;
 };
 
-class Child1 :  public Parent {
+class Child1 final :  public Parent {
     public:
         virtual void info() {
             cout << "I'm child 1" <<endl;
         }
+        virtual int id() const {
+            return 1;
+        }
 };
 
-class Child2 :  public Parent {
+class Child2 final :  public Parent {
     public:
         virtual void info() {
             cout << "I'm child 2" <<endl;
         }
+        virtual int id() const {
+            return 2;
+        }
 };
 
-class Child3 :  public Parent {
+class Child3 final :  public Parent {
     public:
         virtual void info() {
             cout << "I'm child 3" <<endl;
         }
+        virtual int id() const {
+            return 3;
+        }
 };
 
+// Any child held by value, no heap and no pointer to chase; store them side by side in a vector
+using Instance = variant<Child1, Child2, Child3>;
+
 // Delegate the object creation to the factory rather than the user so objects can be created at run time
 class Factory {
     public:
+        // nullptr for an unknown id
         Parent* createInstance(int a) {
             switch (a) {
                 case 1:
@@ -46,12 +71,74 @@ class Factory {
                     return new Child2();
                 case 3:
                     return new Child3();
-                case 4:
+                default:
                     return nullptr;
             }
         }
+        // the same choice made by value, empty for an unknown id
+        optional<Instance> createValue(int a) {
+            switch (a) {
+                case 1:
+                    return Child1();
+                case 2:
+                    return Child2();
+                case 3:
+                    return Child3();
+                default:
+                    return nullopt;
+            }
+        }
 };
 
+// hardware cache misses of this thread between start() and stop(), -1 where perf is not allowed
+class CacheMisses {
+    public:
+        CacheMisses() {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+        ~CacheMisses() {
+            if (fd >= 0) close(fd);
+        }
+        void start() {
+            if (fd < 0) return;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        long stop() {
+            if (fd < 0) return -1;
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t count = 0;
+            return read(fd, &count, sizeof(count)) == sizeof(count) ? long(count) : -1;
+        }
+    private:
+        int fd;
+};
+
+// create(ids) then sum(), timed apart, with the cache misses of the sum
+template <class Create, class Sum>
+void benchmark(const char* name, const vector<int>& ids, Create create, Sum sum) {
+    CacheMisses misses;
+    auto start = chrono::steady_clock::now();
+    auto objects = create(ids);
+    auto created = chrono::steady_clock::now();
+    misses.start();
+    long total = sum(objects);
+    long missed = misses.stop();
+    chrono::duration<double, nano> make = created - start, walk = chrono::steady_clock::now() - created;
+    cout << name << ": create " << make.count() / ids.size() << " ns, iterate " << walk.count() / ids.size()
+         << " ns, ";
+    if (missed < 0) cout << "cache misses n/a";
+    else cout << double(missed) / ids.size() << " cache misses per object";
+    cout << " (checksum " << total << ")" << endl;
+}
+
 int main() {
     vector<int> inputs;
     inputs.push_back(1); inputs.push_back(3); inputs.push_back(2);
@@ -66,5 +153,37 @@ int main() {
     for (Parent* obj : outputs) {
         delete obj;
     }
+    if (!factory.createValue(4)) cout << "no child 4" << endl;
 
+    // one new per instance against instances by value in one vector
+    const size_t n = 10000000;
+    vector<int> ids(n);
+    mt19937 rng(42);
+    for (int& id : ids) id = 1 + rng() % 3;
+    benchmark("pointers", ids,
+        [&](const vector<int>& ids) {
+            vector<unique_ptr<Parent>> objects;
+            objects.reserve(ids.size());
+            for (int id : ids) objects.emplace_back(factory.createInstance(id));
+            return objects;
+        },
+        [](vector<unique_ptr<Parent>>& objects) {
+            long total = 0;
+            for (auto& obj : objects) total += obj->id();
+            return total;
+        });
+    benchmark("values", ids,
+        [&](const vector<int>& ids) {
+            vector<Instance> objects;
+            objects.reserve(ids.size());
+            for (int id : ids) objects.push_back(*factory.createValue(id));
+            return objects;
+        },
+        [](vector<Instance>& objects) {
+            long total = 0;
+            for (Instance& obj : objects) total += visit([](auto& child) { return child.id(); }, obj);
+            return total;
+        });
+    cout << "pointers allocate " << n << " objects of " << sizeof(Child1) << " bytes, values one block of "
+         << n << " x " << sizeof(Instance) << " bytes" << endl;
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+/*
+ * The observer pattern is defined as a one-to-many dependency between objects
+ * so that when one object changes state, all its dependents are notified and updated automatically.
+ */
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<functional>
+#include<iostream>
+#include<memory>
+#include<span>
+#include<stdexcept>
+#include<thread>
+#include<type_traits>
+#include<vector>
+
+inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/* A publish/subscribe bus for many publishers and many subscribers, with no lock.
+ * Events go through one ring of capacity slots. A publisher claims the next sequence number,
+ * waits until the event that held the slot one lap before is published and every subscriber
+ * is done with it, copies its event in and marks the slot with the sequence. Each subscriber runs its own
+ * thread with its own cursor, takes up to maxBatch published events at a time and hands them
+ * to its callback together.
+ * Subscribers sit in a fixed table that publishers scan, but only when the last scan no longer
+ * leaves room, so most publishes touch nothing but the claim counter and their slot. A new
+ * subscriber is marked active before it reads where to start, so a publisher that missed it
+ * can only have claimed sequences before that start. A leaving subscriber's thread is stopped
+ * before its entry is freed, so events in flight simply stop waiting for it.
+ */
+template <class Event>
+class EventBus {
+    public:
+        static_assert(std::is_trivially_copyable_v<Event>, "events are copied in and out of the ring");
+        // events of one batch, the first of them numbered first
+        using Callback = std::function<void(uint64_t first, std::span<const Event> events)>;
+        static constexpr size_t maxSubscribers = 64;
+
+        explicit EventBus(size_t capacity = 1 << 14) : mask(capacity - 1), slots(new Slot[capacity]) {
+            if (capacity == 0 || (capacity & mask)) throw std::invalid_argument("capacity must be a power of two");
+        }
+        ~EventBus() {
+            for (size_t i = 0; i < maxSubscribers; ++i) {
+                if (subscribers[i].state.load() == Active) unsubscribe(int(i));
+            }
+        }
+        EventBus(const EventBus&) = delete;
+        void operator=(const EventBus&) = delete;
+
+        void publish(const Event& event) {
+            uint64_t s = claimed.fetch_add(1);
+            Slot& slot = slots[s & mask];
+            // the publisher one lap before may still be writing this slot, subscribers or not
+            uint64_t previous = s < capacity() ? 0 : s - capacity() + 1;
+            while (slot.published.load(std::memory_order_acquire) != previous) std::this_thread::yield();
+            waitForRoom(s);
+            slot.event = event;
+            slot.published.store(s + 1, std::memory_order_release);
+        }
+
+        // an id for unsubscribe, -1 when every entry is taken; callback runs on the subscriber's own thread
+        int subscribe(Callback callback, size_t maxBatch = 256) {
+            for (size_t i = 0; i < maxSubscribers; ++i) {
+                Subscriber& sub = subscribers[i];
+                int expected = Free;
+                if (!sub.state.compare_exchange_strong(expected, Joining)) continue;
+                size_t seen = used.load();
+                while (seen <= i && !used.compare_exchange_weak(seen, i + 1)) {}
+                sub.cursor.store(claimed.load());
+                sub.state.store(Active);
+                uint64_t start = claimed.load();
+                sub.cursor.store(start);
+                sub.stop.store(false, std::memory_order_relaxed);
+                sub.thread = std::thread(&EventBus::deliver, this, std::ref(sub), std::move(callback), maxBatch, start);
+                return int(i);
+            }
+            return -1;
+        }
+        // returns once the callback has run for the last time
+        void unsubscribe(int id) {
+            Subscriber& sub = subscribers[id];
+            sub.stop.store(true, std::memory_order_relaxed);
+            sub.thread.join();
+            sub.state.store(Free);
+        }
+
+    private:
+        enum { Free, Joining, Active };
+
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> published{0};  // sequence + 1 of the event in the slot
+            Event event;
+        };
+        struct alignas(64) Subscriber {
+            std::atomic<int> state{Free};
+            std::atomic<uint64_t> cursor{0};  // next sequence it reads, every one before is done with
+            std::atomic<bool> stop{false};
+            std::thread thread;
+        };
+
+        uint64_t capacity() const { return mask + 1; }
+
+        // the oldest sequence some subscriber still needs, at most the next claim
+        uint64_t oldestNeeded() {
+            uint64_t oldest = claimed.load();
+            size_t n = used.load();
+            for (size_t i = 0; i < n; ++i) {
+                if (subscribers[i].state.load() == Active) {
+                    oldest = std::min(oldest, subscribers[i].cursor.load(std::memory_order_acquire));
+                }
+            }
+            return oldest;
+        }
+
+        void waitForRoom(uint64_t s) {
+            if (s < gate.load(std::memory_order_acquire) + capacity()) return;
+            for (;;) {
+                uint64_t oldest = oldestNeeded();
+                gate.store(oldest, std::memory_order_release);
+                if (s < oldest + capacity()) return;
+                std::this_thread::yield();
+            }
+        }
+
+        void deliver(Subscriber& sub, Callback callback, size_t maxBatch, uint64_t next) {
+            std::vector<Event> batch;
+            batch.reserve(maxBatch);
+            unsigned idle = 0;
+            while (!sub.stop.load(std::memory_order_relaxed)) {
+                batch.clear();
+                while (batch.size() < maxBatch) {
+                    Slot& slot = slots[(next + batch.size()) & mask];
+                    if (slot.published.load(std::memory_order_acquire) != next + batch.size() + 1) break;
+                    batch.push_back(slot.event);
+                }
+                if (batch.empty()) {
+                    if (++idle > 64) std::this_thread::yield();
+                    continue;
+                }
+                idle = 0;
+                uint64_t first = next;
+                next += batch.size();
+                // the slots are free again before the callback runs
+                sub.cursor.store(next, std::memory_order_release);
+                callback(first, std::span<const Event>(batch));
+            }
+        }
+
+        const uint64_t mask;
+        std::unique_ptr<Slot[]> slots;
+        alignas(64) std::atomic<uint64_t> claimed{0};
+        alignas(64) std::atomic<uint64_t> gate{0};  // oldestNeeded() as of the last scan
+        std::atomic<size_t> used{0};                 // subscriber entries ever taken
+        Subscriber subscribers[maxSubscribers];
+};
+
+struct Tick {
+    uint32_t producer;
+    uint64_t count;
+    int64_t sentNs;
+};
+
+// what one subscriber saw
+struct Received {
+    std::vector<int64_t> latencies;
+    std::vector<uint64_t> last;
+    long outOfOrder = 0;
+    std::atomic<long> count{0};
+
+    explicit Received(unsigned producers) : last(producers, 0) {}
+    void take(std::span<const Tick> ticks, bool timed) {
+        int64_t now = nowNs();
+        for (const Tick& t : ticks) {
+            if (t.count <= last[t.producer]) ++outOfOrder;
+            last[t.producer] = t.count;
+            if (timed) latencies.push_back(now - t.sentNs);
+        }
+        count.fetch_add(ticks.size(), std::memory_order_release);
+    }
+};
+
+// events/s and delivery latency with producers publishing perProducer ticks each to subscribers,
+// while one more subscriber keeps joining and leaving
+void benchmark(unsigned producers, unsigned subscribers, uint64_t perProducer) {
+    EventBus<Tick> bus;
+    std::vector<std::unique_ptr<Received>> received;
+    std::vector<int> ids;
+    for (unsigned s = 0; s < subscribers; ++s) {
+        received.push_back(std::make_unique<Received>(producers));
+        Received& r = *received.back();
+        r.latencies.reserve(producers * perProducer);
+        ids.push_back(bus.subscribe([&r](uint64_t, std::span<const Tick> ticks) { r.take(ticks, true); }));
+    }
+    std::atomic<bool> done{false};
+    long joins = 0, churnErrors = 0;
+    std::thread churn([&] {
+        while (!done.load()) {
+            Received r(producers);
+            int id = bus.subscribe([&r](uint64_t, std::span<const Tick> ticks) { r.take(ticks, false); });
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            bus.unsubscribe(id);
+            churnErrors += r.outOfOrder;
+            ++joins;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned p = 0; p < producers; ++p) {
+        workers.emplace_back([&bus, p, perProducer] {
+            for (uint64_t i = 1; i <= perProducer; ++i) bus.publish(Tick{p, i, nowNs()});
+        });
+    }
+    for (std::thread& w : workers) w.join();
+    long expected = long(producers * perProducer);
+    for (auto& r : received) {
+        while (r->count.load(std::memory_order_acquire) < expected) std::this_thread::yield();
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    done.store(true);
+    churn.join();
+    for (int id : ids) bus.unsubscribe(id);
+
+    std::vector<int64_t> all;
+    long errors = churnErrors;
+    for (auto& r : received) {
+        all.insert(all.end(), r->latencies.begin(), r->latencies.end());
+        errors += r->outOfOrder;
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all[size_t(p * (all.size() - 1))] / 1000.0; };
+    std::cout << producers << " producers, " << subscribers << " subscribers: " << expected / seconds.count() / 1e6
+              << " M events/s published, " << expected * subscribers / seconds.count() / 1e6
+              << " M/s delivered, latency us p50 " << percentile(0.5) << " p99 " << percentile(0.99) << " p99.9 "
+              << percentile(0.999) << ", " << joins << " joins while in flight, " << errors << " out of order"
+              << std::endl;
+}
+
+// A subscriber that joins a small ring while many publishers race through it with nobody else
+// listening has to get events every time. Returns false when one stalled or saw them out of order.
+bool joinWhilePublishing(unsigned producers = 16, int rounds = 200) {
+    EventBus<Tick> bus(4);
+    std::atomic<bool> done{false};
+    std::vector<std::thread> workers;
+    for (unsigned p = 0; p < producers; ++p) {
+        workers.emplace_back([&bus, &done, p] {
+            for (uint64_t i = 1; !done.load(std::memory_order_relaxed); ++i) bus.publish(Tick{p, i, 0});
+        });
+    }
+    bool ok = true;
+    for (int round = 0; round < rounds && ok; ++round) {
+        Received r(producers);
+        int id = bus.subscribe([&r](uint64_t, std::span<const Tick> ticks) { r.take(ticks, false); });
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (r.count.load(std::memory_order_acquire) < 100 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        bus.unsubscribe(id);
+        if (r.count.load() < 100 || r.outOfOrder) {
+            std::cout << "join while publishing: round " << round << " got " << r.count.load() << " events, "
+                      << r.outOfOrder << " out of order" << std::endl;
+            ok = false;
+        }
+    }
+    done.store(true);
+    for (std::thread& w : workers) w.join();
+    return ok;
+}
+
+int main() {
+    EventBus<int> bus(8);
+    int a = bus.subscribe([](uint64_t first, std::span<const int> events) {
+        for (size_t i = 0; i < events.size(); ++i) std::cout << "observer A got event " << first + i << ": " << events[i] << std::endl;
+    });
+    for (int i = 0; i < 3; ++i) bus.publish(i * 10);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bus.unsubscribe(a);
+
+    if (!joinWhilePublishing()) return 1;
+    std::cout << "join while publishing: ok" << std::endl;
+
+    for (unsigned producers : {1u, 2u, 4u}) {
+        for (unsigned subscribers : {1u, 4u, 16u}) benchmark(producers, subscribers, 400000 / producers);
+    }
+}
@@ -1,15 +1,249 @@
-/* the Prototype pattern is defined as specify the kind of objects to create 
+/* the Prototype pattern is defined as specify the kind of objects to create
  * using a prototypical instance as a model and making copies of the prototype to create new objects.
  */
+#include<atomic>
+#include<chrono>
+#include<cstdint>
 #include<iostream>
+#include<memory>
+#include<new>
+#include<thread>
+#include<utility>
+#include<vector>
 
 class ClonableParent {
     public:
         virtual ClonableParent* makeCopy() const = 0;
+        // a copy that lives in its type's ClonePool, give it back with recycle() instead of delete
+        virtual ClonableParent* makePooledCopy() const = 0;
+        virtual void recycle() = 0;
         virtual void printData() const = 0;
+        virtual ~ClonableParent() = default;
 };
 
-class ClonableChild : public ClonableParent {
+/* Fixed size slots for objects of one type, handed out and taken back from any thread.
+ * Slots come in slabs of slabSize that are never freed while the pool lives. Each thread
+ * keeps a few free slots of its own, so most clones and releases touch no shared memory.
+ * Free slots beyond that move in batches of batchSize through a lock-free stack; its head
+ * carries a tag that changes on every pop, so a thread preempted between reading the
+ * head and swapping it cannot pop a batch that was taken and given back meanwhile.
+ * Runs of objects that must sit next to each other do not fit the slots, which carry their
+ * index between objects; they come from blocks instead, and each thread keeps the largest
+ * block it gave back for the next run.
+ */
+template <class T>
+class ClonePool {
+    public:
+        // one pool per type, the slab of that type
+        static ClonePool& instance() {
+            static ClonePool pool;
+            return pool;
+        }
+        ClonePool(const ClonePool&) = delete;
+        void operator=(const ClonePool&) = delete;
+        ~ClonePool() {
+            for (auto& slab : slabs) delete slab.load(std::memory_order_relaxed);
+        }
+
+        // a copy that throws leaves its slot in the pool
+        T* clone(const T& prototype) {
+            Cache& c = cache();
+            if (c.count == 0) refill(c);
+            uint32_t index = c.items[c.count - 1];
+            T* object = new (slot(index).bytes) T(prototype);
+            --c.count;
+            return object;
+        }
+        void release(T* object) {
+            object->~T();
+            Cache& c = cache();
+            if (c.count == cacheSize) {
+                c.count -= batchSize;
+                pushBatch(c.items + c.count, batchSize);
+            }
+            c.items[c.count++] = reinterpret_cast<Slot*>(object)->index;
+        }
+
+        // raw storage for at least n objects side by side, capacity is set to how many fit
+        T* takeBlock(size_t n, size_t& capacity) {
+            Spare& spare = this->spare();
+            if (spare.block && spare.capacity >= n) {
+                capacity = spare.capacity;
+                return std::exchange(spare.block, nullptr);
+            }
+            capacity = n;
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        }
+        // storage from takeBlock, its objects already destroyed
+        void giveBlock(T* block, size_t capacity) {
+            Spare& spare = this->spare();
+            if (spare.block && spare.capacity >= capacity) {
+                ::operator delete(block, std::align_val_t(alignof(T)));
+                return;
+            }
+            if (spare.block) ::operator delete(spare.block, std::align_val_t(alignof(T)));
+            spare.block = block;
+            spare.capacity = capacity;
+        }
+
+    private:
+        static constexpr uint32_t slabSize = 4096;
+        static constexpr uint32_t maxSlabs = 4096;
+        static constexpr uint32_t batchSize = 32;
+        static constexpr uint32_t cacheSize = 2 * batchSize;
+        static constexpr uint32_t none = UINT32_MAX;
+
+        struct Slot {
+            alignas(T) unsigned char bytes[sizeof(T)];
+            uint32_t index;  // its place in the pool, set once when the slab is made
+        };
+        // free list links, kept apart from the objects
+        struct Link {
+            std::atomic<uint32_t> next;       // next slot of the same batch
+            std::atomic<uint32_t> nextBatch;  // first slot of the batch below, on a batch's first slot
+            std::atomic<uint32_t> length;     // slots in the batch, on its first slot
+        };
+        struct Slab {
+            Slot slots[slabSize];
+            Link links[slabSize];
+        };
+        // free slots of one thread, given back to the pool when the thread ends
+        struct Cache {
+            uint32_t items[cacheSize];
+            uint32_t count = 0;
+            ~Cache() {
+                if (count) ClonePool::instance().pushBatch(items, count);
+            }
+        };
+
+        // the block a thread gave back last, freed when the thread ends
+        struct Spare {
+            T* block = nullptr;
+            size_t capacity = 0;
+            ~Spare() {
+                if (block) ::operator delete(block, std::align_val_t(alignof(T)));
+            }
+        };
+
+        ClonePool() = default;
+
+        static Cache& cache() {
+            static thread_local Cache c;
+            return c;
+        }
+        static Spare& spare() {
+            static thread_local Spare s;
+            return s;
+        }
+
+        Slot& slot(uint32_t index) { return slabs[index / slabSize].load(std::memory_order_acquire)->slots[index % slabSize]; }
+        Link& link(uint32_t index) { return slabs[index / slabSize].load(std::memory_order_acquire)->links[index % slabSize]; }
+
+        // head is (tag << 32) | first slot of the top batch
+        static uint64_t pack(uint64_t tag, uint32_t index) { return tag << 32 | index; }
+
+        void pushBatch(const uint32_t* items, uint32_t n) {
+            for (uint32_t i = 0; i + 1 < n; ++i) link(items[i]).next.store(items[i + 1], std::memory_order_relaxed);
+            link(items[0]).length.store(n, std::memory_order_relaxed);
+            pushChain(items[0], items[0]);
+        }
+
+        // pushes the batches first..last, already linked through nextBatch
+        void pushChain(uint32_t first, uint32_t last) {
+            uint64_t head = free.load(std::memory_order_relaxed);
+            do {
+                link(last).nextBatch.store(uint32_t(head), std::memory_order_relaxed);
+            } while (!free.compare_exchange_weak(head, pack(head >> 32, first), std::memory_order_release,
+                                                 std::memory_order_relaxed));
+        }
+
+        void refill(Cache& c) {
+            uint64_t head = free.load(std::memory_order_acquire);
+            while (uint32_t(head) != none) {
+                uint32_t top = uint32_t(head);
+                uint64_t rest = pack((head >> 32) + 1, link(top).nextBatch.load(std::memory_order_relaxed));
+                if (free.compare_exchange_weak(head, rest, std::memory_order_acquire, std::memory_order_acquire)) {
+                    uint32_t n = link(top).length.load(std::memory_order_relaxed);
+                    for (uint32_t i = 0, s = top; i < n; ++i, s = link(s).next.load(std::memory_order_relaxed)) {
+                        c.items[c.count++] = s;
+                    }
+                    return;
+                }
+            }
+            grow(c);
+        }
+
+        // a new slab: one batch for the caller, the rest on the free list
+        void grow(Cache& c) {
+            uint32_t s = slabCount.fetch_add(1, std::memory_order_relaxed);
+            if (s >= maxSlabs) throw std::bad_alloc();
+            Slab* slab = new Slab;
+            uint32_t base = s * slabSize;
+            for (uint32_t i = 0; i < slabSize; ++i) {
+                slab->slots[i].index = base + i;
+                slab->links[i].next.store(base + i + 1, std::memory_order_relaxed);
+                slab->links[i].length.store(batchSize, std::memory_order_relaxed);
+                slab->links[i].nextBatch.store(base + i + batchSize, std::memory_order_relaxed);
+            }
+            slabs[s].store(slab, std::memory_order_release);
+            for (uint32_t i = 0; i < batchSize; ++i) c.items[c.count++] = base + i;
+            pushChain(base + batchSize, base + slabSize - batchSize);
+        }
+
+        std::atomic<uint64_t> free{pack(0, none)};
+        std::atomic<uint32_t> slabCount{0};
+        std::atomic<Slab*> slabs[maxSlabs] = {};
+};
+
+/* n copies of a prototype side by side in one block from its ClonePool, destroyed and given
+ * back together. Walking them walks a plain T[n].
+ * If a copy throws, the ones already made are destroyed and the block goes back before the
+ * exception leaves.
+ */
+template <class T>
+class CloneArray {
+    public:
+        CloneArray(const T& prototype, size_t n) : count(n) {
+            ClonePool<T>& pool = ClonePool<T>::instance();
+            items = pool.takeBlock(n, capacity);
+            try {
+                std::uninitialized_fill_n(items, n, prototype);
+            } catch (...) {
+                pool.giveBlock(items, capacity);
+                throw;
+            }
+        }
+        ~CloneArray() {
+            std::destroy_n(items, count);
+            ClonePool<T>::instance().giveBlock(items, capacity);
+        }
+        CloneArray(const CloneArray&) = delete;
+        void operator=(const CloneArray&) = delete;
+
+        T& operator[](size_t i) { return items[i]; }
+        size_t size() const { return count; }
+        T* begin() { return items; }
+        T* end() { return items + count; }
+
+    private:
+        T* items;
+        size_t count;
+        size_t capacity;
+};
+
+// makePooledCopy and recycle for a concrete clonable, written once
+template <class Derived, class Base = ClonableParent>
+class PooledClonable : public Base {
+    public:
+        virtual ClonableParent* makePooledCopy() const {
+            return ClonePool<Derived>::instance().clone(static_cast<const Derived&>(*this));
+        }
+        virtual void recycle() {
+            ClonePool<Derived>::instance().release(static_cast<Derived*>(this));
+        }
+};
+
+class ClonableChild : public PooledClonable<ClonableChild> {
     public:
         ClonableChild(int a, float b):field1(a), field2(b) {}
         virtual ClonableParent* makeCopy() const {
@@ -19,6 +253,7 @@ class ClonableChild : public ClonableParent {
         virtual void printData() const {
             std::cout << field1 << " " << field2 << std::endl;
         }
+        int key() const { return field1; }
     private:
         int field1;
         float field2;
@@ -29,9 +264,39 @@ class CloneFactory {
         ClonableParent* getClone(ClonableParent* other) const {
             return other->makeCopy();
         }
+        // from the pool of other's type, give it back with recycle()
+        ClonableParent* getPooledClone(const ClonableParent* other) const {
+            return other->makePooledCopy();
+        }
+        void recycle(ClonableParent* clone) const {
+            clone->recycle();
+        }
+        // n copies from the pool at once, given back when the CloneArray goes
+        template <class T>
+        CloneArray<T> cloneN(const T& prototype, size_t n) const {
+            return CloneArray<T>(prototype, n);
+        }
 };
 
-
+// ns per clone, every thread making and dropping batches of clones of prototype
+template <class Make, class Drop>
+double benchmark(unsigned threads, size_t perThread, Make make, Drop drop) {
+    constexpr size_t batch = 1000;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            std::vector<ClonableParent*> clones(batch);
+            for (size_t done = 0; done < perThread; done += batch) {
+                for (ClonableParent*& c : clones) c = make();
+                for (ClonableParent* c : clones) drop(c);
+            }
+        });
+    }
+    for (std::thread& w : workers) w.join();
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+    return ns.count() / (threads * perThread);
+}
 
 int main() {
     CloneFactory factory;
@@ -39,8 +304,29 @@ int main() {
     ClonableParent* cloned = factory.getClone(toBeCloned);
     toBeCloned->printData();
     cloned->printData();
+    ClonableParent* pooled = factory.getPooledClone(toBeCloned);
+    pooled->printData();
+    factory.recycle(pooled);
     delete toBeCloned;
     delete cloned;
-}
-
 
+    // new/delete against the pool, single threaded and contended
+    ClonableChild prototype(7, 3.5f);
+    const size_t n = 4000000;
+    for (unsigned threads : {1u, 4u}) {
+        double heap = benchmark(threads, n / threads, [&] { return factory.getClone(&prototype); },
+                                [](ClonableParent* c) { delete c; });
+        double pool = benchmark(threads, n / threads, [&] { return factory.getPooledClone(&prototype); },
+                                [&](ClonableParent* c) { factory.recycle(c); });
+        std::cout << threads << " thread(s): new/delete " << heap << " ns/clone, pool " << pool << " ns/clone"
+                  << std::endl;
+    }
+    auto start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (int round = 0; round < 4; ++round) {
+        CloneArray<ClonableChild> copies = factory.cloneN(prototype, n / 4);
+        for (ClonableChild& c : copies) sum += c.key();
+    }
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+    std::cout << "cloneN " << ns.count() / n << " ns/clone (checksum " << sum << ")" << std::endl;
+}
@@ -2,7 +2,16 @@
  * The Singleton pattern is defined as ensuring that only a single instance of a class exists 
  * and a global point of access to it exists.
  */
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
 using namespace std;
 
 class Singleton {
@@ -15,14 +24,114 @@ class Singleton {
         void address() {
             cout << this << endl;
         }
+        void hit() {
+            hits.fetch_add(1, memory_order_relaxed);
+        }
+        long count() const {
+            return hits.load(memory_order_relaxed);
+        }
         // don't allow copy constructor and assignment operator
         Singleton(const Singleton&) = delete;
         void operator=(const Singleton&) = delete;
     private:
         // don't allow construction
         Singleton() = default;
+        atomic<long> hits{0};
 };
 
+/* Still one object per type, but its state is split into shards so threads stop sharing a
+ * cache line: local() is this thread's own T, perCore() the T of the core the caller runs on.
+ * Each shard sits on its own cache line. Nothing is locked to reach a shard; the registry
+ * mutex is only taken when a thread makes its first shard and when the shards are merged.
+ * A thread's shard outlives the thread, so what it counted still shows in the merge.
+ * T's state must stay readable while its owner writes it (atomics), since merge() may run
+ * at any time, and a per-core T may be used by two threads that share a core.
+ */
+template <class T>
+class Sharded {
+    public:
+        static Sharded& getInstance() {
+            static Sharded instance;
+            return instance;
+        }
+        Sharded(const Sharded&) = delete;
+        void operator=(const Sharded&) = delete;
+
+        T& local() {
+            static thread_local T* mine = nullptr;
+            if (!mine) mine = &addThreadShard();
+            return *mine;
+        }
+        T& perCore() {
+            unsigned cpu = unsigned(sched_getcpu());
+            return cores[cpu < coreCount ? cpu : cpu % coreCount].value;
+        }
+
+        // f(shard) on every thread and core shard
+        template <class F>
+        void forEach(F f) {
+            lock_guard<mutex> lock(registry);
+            for (auto& shard : threads) f(as_const(shard->value));
+            for (size_t i = 0; i < coreCount; ++i) f(as_const(cores[i].value));
+        }
+        // folds every shard into init with merge(sum, shard)
+        template <class R, class Merge>
+        R merge(R init, Merge merge) {
+            forEach([&](const T& shard) { init = merge(move(init), shard); });
+            return init;
+        }
+
+    private:
+        struct alignas(64) Shard {
+            T value;
+        };
+
+        Sharded() : coreCount(max(1L, sysconf(_SC_NPROCESSORS_CONF))), cores(new Shard[coreCount]) {}
+
+        T& addThreadShard() {
+            lock_guard<mutex> lock(registry);
+            threads.push_back(make_unique<Shard>());
+            return threads.back()->value;
+        }
+
+        size_t coreCount;
+        unique_ptr<Shard[]> cores;
+        mutex registry;
+        vector<unique_ptr<Shard>> threads;
+};
+
+// a counter to shard, safe to read while it is being added to
+class Counter {
+    public:
+        void add(long n) {
+            value.fetch_add(n, memory_order_relaxed);
+        }
+        // add() without the locked instruction, for a counter only one thread writes
+        void addOwned(long n) {
+            value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed);
+        }
+        long get() const {
+            return value.load(memory_order_relaxed);
+        }
+    private:
+        atomic<long> value{0};
+};
+
+// millions of hits per second when threads each call hit() perThread times
+template <class Hit>
+double benchmark(unsigned threads, long perThread, Hit hit) {
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            for (long i = 0; i < perThread; ++i) hit();
+        });
+    }
+    for (thread& w : workers) w.join();
+    chrono::duration<double, micro> us = chrono::steady_clock::now() - start;
+    return threads * perThread / us.count();
+}
+
 
 
 int main() {
@@ -30,4 +139,19 @@ int main() {
     Singleton& singleton2 = Singleton::getInstance();
     singleton1.address();
     singleton2.address();
+
+    // one shared counter against thread and core shards, from 1 to 64 threads
+    const long perThread = 2000000;
+    auto& counters = Sharded<Counter>::getInstance();
+    auto total = [&] { return counters.merge(0L, [](long sum, const Counter& c) { return sum + c.get(); }); };
+    for (unsigned threads = 1; threads <= 64; threads *= 2) {
+        long before = total();
+        double global = benchmark(threads, perThread, [] { Singleton::getInstance().hit(); });
+        double local = benchmark(threads, perThread, [&] { counters.local().addOwned(1); });
+        double core = benchmark(threads, perThread, [&] { counters.perCore().add(1); });
+        cout << threads << " threads: global " << global << " M/s, thread-local " << local << " M/s, per-core "
+             << core << " M/s" << endl;
+        if (total() - before != 2 * threads * perThread) cout << "lost counts" << endl;
+    }
+    cout << "global count " << Singleton::getInstance().count() << ", sharded count " << total() << endl;
 }
\ No newline at end of file
@@ -55,23 +55,114 @@ Explanation of Output:
 
 // Factory pattern + Singlton pattern
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cmath>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include<iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
+// Build with -DZOOX_COUNT_ALLOCATIONS=1 for zoox check-allocs; otherwise operator new is
+// left to the library
+#ifndef ZOOX_COUNT_ALLOCATIONS
+#define ZOOX_COUNT_ALLOCATIONS 0
+#endif
+
+#if ZOOX_COUNT_ALLOCATIONS
+// Every operator new on this thread so far, zoox check-allocs reads it. Per thread, so
+// counting costs no shared cache line.
+static thread_local uint64_t allocations = 0;
+
+// Tries allocate until it succeeds, calling the new handler between tries as operator new
+// must, and throws bad_alloc once there is none
+template <class Allocate>
+static void* allocate_or_throw(Allocate allocate) {
+    for (;;) {
+        if (void* p = allocate()) return p;
+        new_handler handler = get_new_handler();
+        if (!handler) throw bad_alloc();
+        handler();
+    }
+}
+
+// noinline throughout, or gcc sees malloc and operator delete meet and warns of a mismatch
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++allocations;
+    return allocate_or_throw([&] { return malloc(size ? size : 1); });
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+__attribute__((noinline)) void* operator new(size_t size, align_val_t align) {
+    ++allocations;
+    size_t a = static_cast<size_t>(align);
+    return allocate_or_throw([&] { return aligned_alloc(a, (size + a - 1) / a * a); });
+}
+
+__attribute__((noinline)) void operator delete(void* p, align_val_t) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+#endif
+
 enum Seat { Economy, Premium, Business};
 
-enum Airline { Delta, United, SouthWest};
+// Fixed underlying type: a TariffTable hands out ids past the named airlines
+enum Airline : uint8_t { Delta, United, SouthWest, LuigiAir};
+
+constexpr size_t SeatCount = Business + 1;
+constexpr size_t AirlineCount = LuigiAir + 1;
 
 unordered_map<string, Airline> airlines {
   {"Delta", Delta}, 
   {"United", United}, 
-  {"SouthWest", SouthWest}
+  {"SouthWest", SouthWest},
+  {"LuigiAir", LuigiAir}
 };
 
 unordered_map<string, Seat> seats  {
@@ -90,11 +181,18 @@ class AirlineCalculator{
 public:
     // Factory pattern
     static AirlineCalculator* create(Airline airline);
+    // Plugs in a calculator for an airline past the built-in ones, create returns it from then on
+    static void add(Airline airline, AirlineCalculator* calculator) { plugins()[airline] = calculator; }
     // Calculate total cost
     virtual float calculate(const Ticket& ticket) const = 0;
     virtual ~AirlineCalculator() = default;
 
 protected:
+    static AirlineCalculator** plugins() {
+        static AirlineCalculator* calculators[256] = {};
+        return calculators;
+    }
+
     // Calculate operating cost
     virtual float getOpCost (Ticket ticket) const {
         float opCost = 0.;
@@ -180,6 +278,23 @@ public:
 private:
     SouthwestCalculator() = default;
 };
+
+class LuigiAirCalculator:public AirlineCalculator{
+public:
+    float calculate(const Ticket& ticket) const override{
+        return max(100.f, 2 * getOpCost(ticket));
+    }
+
+    static AirlineCalculator* instance() {
+        static LuigiAirCalculator calc;
+        return &calc;
+    }
+
+    virtual ~LuigiAirCalculator() = default;
+
+private:
+    LuigiAirCalculator() = default;
+};
  
 // Factory pattern
 AirlineCalculator*  AirlineCalculator::create(Airline airline){
@@ -193,46 +308,4300 @@ AirlineCalculator*  AirlineCalculator::create(Airline airline){
         case SouthWest:
             // Singleton pattern
             return SouthwestCalculator::instance();
+        case LuigiAir:
+            // Singleton pattern
+            return LuigiAirCalculator::instance();
     }
+    return plugins()[airline];
 }
 
-static Ticket parse_ticket(const string& s) {
-    // split by space
-    vector<string> arr;
-    std::stringstream ss(s);
-    std::string token;
-    while (std::getline(ss, token, ' ') ) {
-        arr.push_back(token);
+// Compile time twins of the calculators above. A policy only has static functions, so
+// the base class reaches the derived ones through the template argument (CRTP) and
+// the whole cost formula can be inlined where it is used.
+template <typename Derived>
+struct AirlinePolicy {
+    static float opCost(Seat seat, float d) {
+        switch(seat) {
+            case(Economy):
+                return Derived::economyOpCost(d);
+            case(Premium):
+                return Derived::premiumOpCost(d);
+            case(Business):
+                return Derived::businessOpCost(d);
+        }
+        return 0.;
     }
-    assert(arr.size()== 3);
-    assert(airlines.count(arr[0]));
-    assert(seats.count(arr[2]));
+    static float economyOpCost(float) {
+        return 0.0;
+    }
+    static float premiumOpCost(float) {
+        return 25.0;
+    }
+    static float businessOpCost(float d) {
+        return 50.0 + 0.25 * d;
+    }
+};
 
-    Ticket ticket;
-    ticket.airline = airlines[arr[0]];
-    ticket.seat = seats[arr[2]];
-    ticket.distance = std::stof(arr[1]);
-    return ticket;
+struct DeltaPolicy : AirlinePolicy<DeltaPolicy> {
+    static constexpr Airline id = Delta;
+    static float price(Seat seat, float d) {
+        return opCost(seat, d) + d * 0.5;
+    }
+};
+
+struct UnitedPolicy : AirlinePolicy<UnitedPolicy> {
+    static constexpr Airline id = United;
+    static float price(Seat seat, float d) {
+        return opCost(seat, d) + d * 0.75;
+    }
+    static float premiumOpCost(float d) {
+        return 25. + 0.1 * d;
+    }
+};
+
+struct SouthWestPolicy : AirlinePolicy<SouthWestPolicy> {
+    static constexpr Airline id = SouthWest;
+    static float price(Seat, float d) {
+        return 1. * d;
+    }
+};
+
+struct LuigiAirPolicy : AirlinePolicy<LuigiAirPolicy> {
+    static constexpr Airline id = LuigiAir;
+    static float price(Seat seat, float d) {
+        return max(100.f, 2 * opCost(seat, d));
+    }
+};
+
+// Airlines known at compile time. price expands into one comparison per policy with
+// the formula inlined behind it, no singleton and no vtable. Any airline that is not
+// registered goes through the virtual AirlineCalculator::create, e.g. plugins.
+template <typename... Policies>
+struct PolicyRegistry {
+    static float price(const Ticket& ticket) {
+        float cost;
+        bool found = ((ticket.airline == Policies::id && (cost = Policies::price(ticket.seat, ticket.distance), true)) || ...);
+        if (found) return cost;
+        return AirlineCalculator::create(ticket.airline)->calculate(ticket);
+    }
+};
+
+using Airlines = PolicyRegistry<DeltaPolicy, UnitedPolicy, SouthWestPolicy, LuigiAirPolicy>;
+
+// Name lookups switch on length first so a lookup is one compare, no hashing and no string
+static bool parse_airline(string_view name, Airline& airline) {
+    switch (name.size()) {
+        case 5:
+            if (name == "Delta") { airline = Delta; return true; }
+            break;
+        case 6:
+            if (name == "United") { airline = United; return true; }
+            break;
+        case 8:
+            if (name == "LuigiAir") { airline = LuigiAir; return true; }
+            break;
+        case 9:
+            if (name == "SouthWest") { airline = SouthWest; return true; }
+            break;
+    }
+    return false;
 }
- 
-// unordered_map<string, AirlineCalculator*> airclcs{{"Delta",DeltaCalculator::instance()}, {"United",UnitedCalculator::instance()}, {"SouthWest",SouthwestCalculator::instance()}};
 
-vector<float> process_tickets(vector<string> tickets){
-    vector<float> costs;
-    for(const string& ticket_str : tickets) {
-        Ticket ticket = parse_ticket(ticket_str);
- 
-        AirlineCalculator* clc = AirlineCalculator::create(ticket.airline);
-        costs.push_back(clc->calculate(ticket));
+static bool parse_seat(string_view name, Seat& seat) {
+    switch (name.size()) {
+        case 7:
+            if (name == "Economy") { seat = Economy; return true; }
+            if (name == "Premium") { seat = Premium; return true; }
+            break;
+        case 8:
+            if (name == "Business") { seat = Business; return true; }
+            break;
     }
-    return costs;
+    return false;
 }
- 
-int main() {
-    vector<string> input{"United 150.0 Premium", "United 120.0 Economy","United 100.0 Business","Delta 60.0 Economy","Delta 60.0 Premium","Delta 60.0 Business", "SouthWest 1000.0 Economy", "SouthWest 4000.0 Economy"};
-    vector<float> costs = process_tickets(input);
-    for(int i = 0 ; i < input.size(); i++){
-        cout << input[i] << " cost: $" << costs[i]<< endl;
+
+// Cuts the next blank separated token off the front of s
+static string_view next_token(string_view& s) {
+    size_t begin = 0;
+    while (begin < s.size() && s[begin] == ' ') ++begin;
+    size_t end = begin;
+    while (end < s.size() && s[end] != ' ') ++end;
+    string_view token = s.substr(begin, end - begin);
+    s.remove_prefix(end);
+    return token;
+}
+
+// Why a line was rejected. The parsers return this rather than assert or throw, so a bad
+// line costs no more than a good one.
+enum class ParseError : uint8_t { None, Fields, Airline, Distance, Seat };
+
+static const char* describe(ParseError error) {
+    switch (error) {
+        case ParseError::None: return "ok";
+        case ParseError::Fields: return "expected <airline> <distance> <seat>";
+        case ParseError::Airline: return "unknown airline";
+        case ParseError::Distance: return "distance is not a plain decimal number of miles";
+        case ParseError::Seat: return "unknown seat class";
+    }
+    return "?";
+}
+
+// A rejected input line, numbered from 1 and counting empty lines
+struct LineError {
+    size_t line;
+    ParseError reason;
+};
+
+// A plain decimal ("1234", "1234.5", ".75") read in one pass: its value in thousandths,
+// rounded half up on the fourth decimal, and, while they fit, all its digits as one integer
+// with fraction of them after the point
+struct Decimal {
+    uint32_t millimiles;
+    uint64_t digits;
+    int fraction;
+    bool exact;  // digits holds every digit
+};
+
+// Exponents, signs and anything past 4294967.295 are rejected
+static bool scan_decimal(string_view text, Decimal& d) {
+    size_t i = 0;
+    uint64_t value = 0;
+    d.digits = 0;
+    d.exact = true;
+    auto keep = [&d](char c) {
+        if (d.digits > numeric_limits<uint64_t>::max() / 10 - 9) d.exact = false;
+        else d.digits = d.digits * 10 + (c - '0');
+    };
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+        value = value * 10 + (text[i] - '0');
+        if (value > numeric_limits<uint32_t>::max()) return false;
+        keep(text[i]);
+    }
+    size_t digits = i;
+    int fraction = 0;
+    if (i < text.size() && text[i] == '.') {
+        for (++i; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, ++digits) {
+            if (fraction < 4) value = value * 10 + (text[i] - '0');
+            ++fraction;
+            keep(text[i]);
+        }
+    }
+    if (digits == 0 || i != text.size()) return false;
+    for (int f = fraction; f < 4; ++f) value *= 10;
+    value = (value + 5) / 10;
+    if (value > numeric_limits<uint32_t>::max()) return false;
+    d.millimiles = value;
+    d.fraction = fraction;
+    return true;
+}
+
+// Plain decimal miles to thousandths of a mile, see scan_decimal
+static bool parse_millimiles(string_view text, uint32_t& distance) {
+    Decimal d;
+    if (!scan_decimal(text, d)) return false;
+    distance = d.millimiles;
+    return true;
+}
+
+// Takes exactly the distances parse_millimiles does, so the float and the cents engine reject
+// the same lines. Up to 2^24 digits and ten decimals both the digits and the power of ten are
+// exact floats, so one division gives the correctly rounded value; longer numbers, which
+// hardly occur as miles, go through from_chars.
+static bool parse_distance(string_view text, float& distance) {
+    static constexpr float powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    Decimal d;
+    if (!scan_decimal(text, d)) return false;
+    if (d.exact && d.digits <= (1u << 24) && d.fraction <= 10) {
+        distance = float(d.digits) / powers[d.fraction];
+        return true;
+    }
+    const char* end = text.data() + text.size();
+    auto [ptr, ec] = from_chars(text.data(), end, distance);
+    return ec == errc() && ptr == end;
+}
+
+// Single pass over the line, nothing is allocated and nothing depends on the locale
+static ParseError parse_ticket(string_view s, Ticket& ticket) {
+    string_view airline = next_token(s);
+    string_view distance = next_token(s);
+    string_view seat = next_token(s);
+    if (seat.empty() || !next_token(s).empty()) return ParseError::Fields;
+    if (!parse_airline(airline, ticket.airline)) return ParseError::Airline;
+    if (!parse_distance(distance, ticket.distance)) return ParseError::Distance;
+    if (!parse_seat(seat, ticket.seat)) return ParseError::Seat;
+    return ParseError::None;
+}
+
+// Every calculator above boils down to one clamped line per seat class:
+// price = min(max(slope * miles + intercept, floor), ceiling)
+struct PriceLine {
+    float slope;
+    float intercept;
+    float floor;
+    float ceiling;
+};
+
+constexpr float noLimit = numeric_limits<float>::infinity();
+
+// Rows follow the Airline enum, columns follow the Seat enum
+constexpr PriceLine priceLines[AirlineCount][SeatCount] = {
+    // Delta: 0.50/mile + OperatingCost
+    {{0.50f, 0.f, -noLimit, noLimit}, {0.50f, 25.f, -noLimit, noLimit}, {0.75f, 50.f, -noLimit, noLimit}},
+    // United: 0.75/mile + OperatingCost, Premium pays another 0.10/mile
+    {{0.75f, 0.f, -noLimit, noLimit}, {0.85f, 25.f, -noLimit, noLimit}, {1.00f, 50.f, -noLimit, noLimit}},
+    // SouthWest: 1.00/mile
+    {{1.00f, 0.f, -noLimit, noLimit}, {1.00f, 0.f, -noLimit, noLimit}, {1.00f, 0.f, -noLimit, noLimit}},
+    // LuigiAir: max(100, 2 * OperatingCost)
+    {{0.f, 0.f, 100.f, noLimit}, {0.f, 50.f, 100.f, noLimit}, {0.50f, 100.f, 100.f, noLimit}},
+};
+
+// Price formulas that are not a clamped line, compiled to register code, e.g.
+//
+//   max(100, 2 * op)
+//   if(business, 0.9 * miles, miles) + op
+//
+// Names are miles, op (the seat class operating cost) and the 1/0 seat flags economy,
+// premium and business. Operators are + - * / < <= > >= and the functions min, max
+// and if(cond, then, else). An instruction runs over a whole block of tickets before
+// the next one starts, so decoding it costs once per block instead of once per ticket.
+class FormulaProgram {
+public:
+    static constexpr size_t lanes = 256;
+    static constexpr size_t maxRegs = 24;
+    // registers the inputs are loaded into before run
+    enum Input { Miles, OpCost, IsEconomy, IsPremium, IsBusiness, InputCount };
+
+    using Registers = float[maxRegs][lanes];
+
+    static bool compile(string_view text, FormulaProgram& program, string& error);
+
+    // Evaluates n <= lanes tickets whose inputs are in regs, the price ends up in regs[result()]
+    void run(Registers& regs, size_t n) const {
+        for (const Instr& in : code) {
+            float* d = regs[in.dst];
+            const float* a = regs[in.a];
+            const float* b = regs[in.b];
+            const float* c = regs[in.c];
+            switch (in.op) {
+                case Op::Const: for (size_t i = 0; i < n; ++i) d[i] = in.k; break;
+                case Op::Add: for (size_t i = 0; i < n; ++i) d[i] = a[i] + b[i]; break;
+                case Op::Sub: for (size_t i = 0; i < n; ++i) d[i] = a[i] - b[i]; break;
+                case Op::Mul: for (size_t i = 0; i < n; ++i) d[i] = a[i] * b[i]; break;
+                case Op::Div: for (size_t i = 0; i < n; ++i) d[i] = a[i] / b[i]; break;
+                case Op::Min: for (size_t i = 0; i < n; ++i) d[i] = min(a[i], b[i]); break;
+                case Op::Max: for (size_t i = 0; i < n; ++i) d[i] = max(a[i], b[i]); break;
+                case Op::Less: for (size_t i = 0; i < n; ++i) d[i] = a[i] < b[i]; break;
+                case Op::LessEq: for (size_t i = 0; i < n; ++i) d[i] = a[i] <= b[i]; break;
+                case Op::Select: for (size_t i = 0; i < n; ++i) d[i] = c[i] != 0.f ? a[i] : b[i]; break;
+            }
+        }
+    }
+
+    uint8_t result() const { return out; }
+
+private:
+    enum class Op : uint8_t { Const, Add, Sub, Mul, Div, Min, Max, Less, LessEq, Select };
+
+    struct Instr {
+        Op op;
+        uint8_t dst, a, b, c;
+        float k;
+    };
+
+    // An operand while compiling, constants stay out of registers until they are needed
+    struct Value {
+        bool constant;
+        float k;
+        uint8_t reg;
+    };
+
+    class Compiler;
+
+    vector<Instr> code;
+    uint8_t out = Miles;
+};
+
+// Recursive descent straight to register code. Temporaries are handed out like a
+// stack, an operation's result reuses its lowest temporary operand.
+class FormulaProgram::Compiler {
+public:
+    Compiler(string_view text, FormulaProgram& program) : text(text), program(program) {}
+
+    bool compile(string& error) {
+        program.code.clear();
+        Value v = expr();
+        skip_blanks();
+        if (ok && pos != text.size()) fail("unexpected " + string(text.substr(pos)));
+        if (ok) program.out = reg(v);
+        if (!ok) error = message;
+        return ok;
+    }
+
+private:
+    static float fold(Op op, float a, float b, float c) {
+        switch (op) {
+            case Op::Add: return a + b;
+            case Op::Sub: return a - b;
+            case Op::Mul: return a * b;
+            case Op::Div: return a / b;
+            case Op::Min: return min(a, b);
+            case Op::Max: return max(a, b);
+            case Op::Less: return a < b;
+            case Op::LessEq: return a <= b;
+            case Op::Select: return c != 0.f ? a : b;
+            case Op::Const: break;
+        }
+        return a;
+    }
+
+    Value fail(const string& why) {
+        if (ok) message = why;
+        ok = false;
+        return Value{true, 0.f, 0};
+    }
+
+    uint8_t temp() {
+        if (next == maxRegs) {
+            fail("formula needs too many registers");
+            return 0;
+        }
+        return next++;
+    }
+
+    uint8_t reg(Value v) {
+        if (!v.constant) return v.reg;
+        uint8_t r = temp();
+        program.code.push_back(Instr{Op::Const, r, 0, 0, 0, v.k});
+        return r;
+    }
+
+    // cond is only used by Select: cond ? a : b
+    Value emit(Op op, Value a, Value b, Value cond = Value{true, 0.f, 0}) {
+        if (!ok) return a;
+        if (a.constant && b.constant && cond.constant) return Value{true, fold(op, a.k, b.k, cond.k), 0};
+        uint8_t first = next;
+        uint8_t ra = reg(a), rb = reg(b), rc = op == Op::Select ? reg(cond) : 0;
+        // every temporary at or above first is an operand, so the result can take the lowest
+        uint8_t dst = first;
+        for (uint8_t r : {ra, rb, rc}) {
+            if (r >= InputCount) dst = min(dst, r);
+        }
+        if (dst == next) temp();
+        next = dst + 1;
+        program.code.push_back(Instr{op, dst, ra, rb, rc, 0.f});
+        return Value{false, 0.f, dst};
+    }
+
+    void skip_blanks() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) ++pos;
+    }
+
+    bool accept(string_view token) {
+        skip_blanks();
+        if (text.substr(pos, token.size()) != token) return false;
+        pos += token.size();
+        return true;
+    }
+
+    Value expr() {
+        Value a = sum();
+        if (accept("<=")) return emit(Op::LessEq, a, sum());
+        if (accept(">=")) return emit(Op::LessEq, sum(), a);
+        if (accept("<")) return emit(Op::Less, a, sum());
+        if (accept(">")) return emit(Op::Less, sum(), a);
+        return a;
+    }
+
+    Value sum() {
+        Value a = product();
+        for (;;) {
+            if (accept("+")) a = emit(Op::Add, a, product());
+            else if (accept("-")) a = emit(Op::Sub, a, product());
+            else return a;
+        }
+    }
+
+    Value product() {
+        Value a = unary();
+        for (;;) {
+            if (accept("*")) a = emit(Op::Mul, a, unary());
+            else if (accept("/")) a = emit(Op::Div, a, unary());
+            else return a;
+        }
+    }
+
+    Value unary() {
+        if (accept("-")) return emit(Op::Sub, Value{true, 0.f, 0}, unary());
+        return primary();
+    }
+
+    Value primary() {
+        skip_blanks();
+        if (!ok) return Value{true, 0.f, 0};
+        if (accept("(")) {
+            Value v = expr();
+            if (!accept(")")) return fail("missing )");
+            return v;
+        }
+        if (pos < text.size() && (isdigit(static_cast<unsigned char>(text[pos])) || text[pos] == '.')) {
+            float k;
+            auto [ptr, ec] = from_chars(text.data() + pos, text.data() + text.size(), k);
+            if (ec != errc()) return fail("bad number");
+            pos = ptr - text.data();
+            return Value{true, k, 0};
+        }
+        size_t begin = pos;
+        while (pos < text.size() && isalpha(static_cast<unsigned char>(text[pos]))) ++pos;
+        string_view name = text.substr(begin, pos - begin);
+        if (name == "miles") return Value{false, 0.f, Miles};
+        if (name == "op") return Value{false, 0.f, OpCost};
+        if (name == "economy") return Value{false, 0.f, IsEconomy};
+        if (name == "premium") return Value{false, 0.f, IsPremium};
+        if (name == "business") return Value{false, 0.f, IsBusiness};
+        if (name == "min" || name == "max") {
+            Op op = name == "min" ? Op::Min : Op::Max;
+            if (!accept("(")) return fail("missing ( after " + string(name));
+            Value v = expr();
+            while (accept(",")) v = emit(op, v, expr());
+            if (!accept(")")) return fail("missing )");
+            return v;
+        }
+        if (name == "if") {
+            if (!accept("(")) return fail("missing ( after if");
+            Value cond = expr();
+            if (!accept(",")) return fail("if needs three arguments");
+            Value a = expr();
+            if (!accept(",")) return fail("if needs three arguments");
+            Value b = expr();
+            if (!accept(")")) return fail("missing )");
+            return emit(Op::Select, a, b, cond);
+        }
+        if (name.empty()) return fail(pos < text.size() ? "unexpected " + string(1, text[pos]) : "unexpected end");
+        return fail("unknown name " + string(name));
+    }
+
+    string_view text;
+    FormulaProgram& program;
+    size_t pos = 0;
+    uint8_t next = InputCount;
+    bool ok = true;
+    string message;
+};
+
+bool FormulaProgram::compile(string_view text, FormulaProgram& program, string& error) {
+    return Compiler(text, program).compile(error);
+}
+
+// FNV-1a, continue a running hash by passing it back in as h
+static uint64_t fnv1a(const void* data, size_t len, uint64_t h = 14695981039346656037ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+// Airline names and their price lines, read from a tariff file instead of compiled in.
+// Ids are dense and index lines, so pricing stays one table lookup however many
+// airlines there are. The file format:
+//
+//   # seat class operating costs, flat $ plus $/mile
+//   opcost Business 50 0.25
+//   # price = min(max(miles * $/mile + op * OperatingCost + add, min), max),
+//   # missing terms are 0 and missing limits are open
+//   airline United miles=0.75 op=1
+//   # naming a seat class replaces that class only
+//   airline United Premium miles=0.85 op=1
+//   # anything else is a formula, see FormulaProgram
+//   formula LuigiAir max(100, 2 * op)
+//
+// Lines apply in order, so a later line overrides what an earlier one said.
+class TariffTable {
+public:
+    static constexpr size_t maxAirlines = 256;
+
+    // The four airlines of the problem statement, same as priceLines
+    static const TariffTable& builtin() {
+        static TariffTable table = [] {
+            TariffTable t;
+            const char* names[AirlineCount] = {"Delta", "United", "SouthWest", "LuigiAir"};
+            for (size_t a = 0; a < AirlineCount; ++a) {
+                size_t id = t.add(names[a]);
+                copy(begin(priceLines[a]), end(priceLines[a]), t.lines.begin() + id * SeatCount);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    // On failure error says which line was wrong and why
+    static bool load(const char* path, TariffTable& table, string& error);
+    static bool load(istream& in, const string& source, TariffTable& table, string& error);
+
+    size_t size() const { return names.size(); }
+    const string& name(size_t id) const { return names[id]; }
+    const PriceLine* data() const { return lines.data(); }
+    const PriceLine& line(size_t id, Seat seat) const { return lines[id * SeatCount + seat]; }
+
+    // Program index of an (airline, seat), -1 when the price line applies
+    int formula(size_t id, size_t seat) const { return formulas[id * SeatCount + seat]; }
+    const vector<FormulaProgram>& programs() const { return compiled; }
+    // Operating cost of a seat class, the op input of formulas
+    float opCost(size_t seat, float miles) const { return opFlat[seat] + opPerMile[seat] * miles; }
+
+    // Changes whenever anything that goes into the airline's prices changes
+    uint64_t fingerprint(size_t id) const {
+        uint64_t h = 14695981039346656037ull;
+        for (size_t seat = 0; seat < SeatCount; ++seat) {
+            int program = formula(id, seat);
+            if (program < 0) {
+                const PriceLine& l = lines[id * SeatCount + seat];
+                h = fnv1a(&l, sizeof(l), h);
+                continue;
+            }
+            h = fnv1a(sources[program].data(), sources[program].size(), h);
+            h = fnv1a(&opFlat[seat], sizeof(float), h);
+            h = fnv1a(&opPerMile[seat], sizeof(float), h);
+        }
+        return h;
+    }
+
+    // Open addressing over a power of two table kept at most half full
+    int find(string_view name) const {
+        if (slots.empty()) return -1;
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash(name) & mask;; i = (i + 1) & mask) {
+            int id = slots[i];
+            if (id < 0 || names[id] == name) return id;
+        }
+    }
+
+private:
+    static size_t hash(string_view name) {
+        return fnv1a(name.data(), name.size());
+    }
+
+    size_t add(string_view name) {
+        names.emplace_back(name);
+        lines.resize(names.size() * SeatCount, PriceLine{0.f, 0.f, -noLimit, noLimit});
+        formulas.resize(names.size() * SeatCount, -1);
+        if (names.size() * 2 > slots.size()) {
+            slots.assign(max<size_t>(16, slots.size() * 2), -1);
+            for (size_t id = 0; id < names.size(); ++id) insert(id);
+        } else {
+            insert(names.size() - 1);
+        }
+        return names.size() - 1;
+    }
+
+    void insert(size_t id) {
+        size_t mask = slots.size() - 1;
+        size_t i = hash(names[id]) & mask;
+        while (slots[i] >= 0) i = (i + 1) & mask;
+        slots[i] = id;
+    }
+
+    vector<string> names;
+    vector<PriceLine> lines;
+    vector<int16_t> formulas;
+    vector<FormulaProgram> compiled;
+    vector<string> sources;  // formula text of each compiled program
+    vector<int16_t> slots;
+    // operating cost of each seat class as flat $ and $/mile, the problem statement's by default
+    float opFlat[SeatCount] = {0.f, 25.f, 50.f};
+    float opPerMile[SeatCount] = {0.f, 0.f, 0.25f};
+};
+
+bool TariffTable::load(const char* path, TariffTable& table, string& error) {
+    ifstream in(path);
+    if (!in) {
+        error = string(path) + ": cannot open";
+        return false;
+    }
+    return load(in, path, table, error);
+}
+
+bool TariffTable::load(istream& in, const string& source, TariffTable& table, string& error) {
+    table = TariffTable();
+    float* opFlat = table.opFlat;
+    float* opPerMile = table.opPerMile;
+    string text;
+    for (int lineNo = 1; getline(in, text); ++lineNo) {
+        auto fail = [&](const string& why) {
+            error = source + ":" + to_string(lineNo) + ": " + why;
+            return false;
+        };
+        string_view rest(text);
+        if (size_t hashPos = rest.find('#'); hashPos != string_view::npos) rest = rest.substr(0, hashPos);
+        if (!rest.empty() && rest.back() == '\r') rest.remove_suffix(1);
+        string_view keyword = next_token(rest);
+        if (keyword.empty()) continue;
+        auto number = [](string_view token, float& value) {
+            const char* end = token.data() + token.size();
+            auto [ptr, ec] = from_chars(token.data(), end, value);
+            return !token.empty() && ec == errc() && ptr == end;
+        };
+
+        if (keyword == "opcost") {
+            Seat seat;
+            if (!parse_seat(next_token(rest), seat)) return fail("unknown seat class");
+            if (!number(next_token(rest), opFlat[seat]) || !number(next_token(rest), opPerMile[seat]))
+                return fail("opcost needs a flat cost and a cost per mile");
+            if (!next_token(rest).empty()) return fail("trailing text");
+            continue;
+        }
+        if (keyword != "airline" && keyword != "formula") return fail("expected opcost, airline or formula");
+
+        string_view name = next_token(rest);
+        if (name.empty()) return fail(string(keyword) + " needs a name");
+        int id = table.find(name);
+        if (id < 0) {
+            if (table.size() == maxAirlines) return fail("too many airlines");
+            id = table.add(name);
+        }
+        size_t firstSeat = 0, lastSeat = SeatCount;
+        if (keyword == "formula") {
+            string_view body = rest;
+            Seat seat;
+            if (parse_seat(next_token(rest), seat)) {
+                firstSeat = seat;
+                lastSeat = seat + 1;
+                body = rest;
+            }
+            FormulaProgram program;
+            string why;
+            if (!FormulaProgram::compile(body, program, why)) return fail(why);
+            if (table.compiled.size() == size_t(numeric_limits<int16_t>::max())) return fail("too many formulas");
+            table.compiled.push_back(move(program));
+            table.sources.emplace_back(body);
+            for (size_t s = firstSeat; s < lastSeat; ++s) table.formulas[id * SeatCount + s] = table.compiled.size() - 1;
+            continue;
+        }
+        float miles = 0.f, op = 0.f, add = 0.f, floor = -noLimit, ceiling = noLimit;
+        for (string_view token = next_token(rest); !token.empty(); token = next_token(rest)) {
+            Seat seat;
+            if (parse_seat(token, seat)) {
+                firstSeat = seat;
+                lastSeat = seat + 1;
+                continue;
+            }
+            size_t eq = token.find('=');
+            string_view key = token.substr(0, min(eq, token.size()));
+            float value;
+            if (eq == string_view::npos || !number(token.substr(eq + 1), value))
+                return fail("expected key=number, got " + string(token));
+            if (key == "miles") miles = value;
+            else if (key == "op") op = value;
+            else if (key == "add") add = value;
+            else if (key == "min") floor = value;
+            else if (key == "max") ceiling = value;
+            else return fail("unknown term " + string(key));
+        }
+        for (size_t seat = firstSeat; seat < lastSeat; ++seat) {
+            table.lines[id * SeatCount + seat] =
+                PriceLine{miles + op * opPerMile[seat], add + op * opFlat[seat], floor, ceiling};
+            table.formulas[id * SeatCount + seat] = -1;
+        }
+    }
+    return true;
+}
+
+// Same as parse_ticket above, only the airline name is resolved through a tariff table
+static ParseError parse_ticket(string_view s, const TariffTable& tariffs, Ticket& ticket) {
+    string_view airline = next_token(s);
+    string_view distance = next_token(s);
+    string_view seat = next_token(s);
+    if (seat.empty() || !next_token(s).empty()) return ParseError::Fields;
+    int id = tariffs.find(airline);
+    if (id < 0) return ParseError::Airline;
+    ticket.airline = static_cast<Airline>(id);
+    if (!parse_distance(distance, ticket.distance)) return ParseError::Distance;
+    if (!parse_seat(seat, ticket.seat)) return ParseError::Seat;
+    return ParseError::None;
+}
+
+// Parsed tickets stored column by column so a batch can be priced with vector loads
+struct TicketBatch {
+    vector<float> distance;
+    vector<uint8_t> airline;
+    vector<uint8_t> seat;
+
+    size_t size() const { return distance.size(); }
+    void reserve(size_t n) {
+        distance.reserve(n);
+        airline.reserve(n);
+        seat.reserve(n);
+    }
+    void clear() {
+        distance.clear();
+        airline.clear();
+        seat.clear();
+    }
+    void push_back(const Ticket& ticket) {
+        distance.push_back(ticket.distance);
+        airline.push_back(ticket.airline);
+        seat.push_back(ticket.seat);
+    }
+};
+
+// Columns of tickets that live somewhere else, a TicketBatch or a mapped column file
+struct TicketColumns {
+    const float* distance;
+    const uint8_t* airline;
+    const uint8_t* seat;
+    size_t size;
+
+    TicketColumns(const float* distance, const uint8_t* airline, const uint8_t* seat, size_t size)
+        : distance(distance), airline(airline), seat(seat), size(size) {}
+    TicketColumns(const TicketBatch& batch)
+        : TicketColumns(batch.distance.data(), batch.airline.data(), batch.seat.data(), batch.size()) {}
+};
+
+// Build with -DZOOX_TELEMETRY=0 to compile the counters out altogether
+#ifndef ZOOX_TELEMETRY
+#define ZOOX_TELEMETRY 1
+#endif
+
+// Where a run spends its time. Every thread counts into its own block, so the hot
+// path never shares a cache line; dump adds the blocks up. Stages are timed per call
+// (a whole batch for the batch path), with the TSC on x86 and steady_clock elsewhere.
+// Off until enable(), and then a disabled check is one predictable branch per call.
+class Telemetry {
+public:
+    enum Stage { Parse, Dispatch, Price, Format, StageCount };
+    static constexpr size_t buckets = 48;
+
+    static void enable() {
+        clockStart = ticks();
+        wallStart = chrono::steady_clock::now();
+        on.store(ZOOX_TELEMETRY, memory_order_relaxed);
+    }
+    static bool enabled() { return ZOOX_TELEMETRY && on.load(memory_order_relaxed); }
+
+    static uint64_t ticks() {
+#if defined(__x86_64__)
+        return __rdtsc();
+#else
+        return chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // Start timing on this thread, every stop then books the time since the last start or stop
+    static void start() {
+        if (enabled()) local().mark = ticks();
+    }
+    static void stop(Stage stage) {
+        if (!enabled()) return;
+        Block& b = local();
+        uint64_t now = ticks();
+        uint64_t spent = now - b.mark;
+        b.mark = now;
+        bump(b.calls[stage], 1);
+        bump(b.ticks[stage], spent);
+        bump(b.histogram[stage][min<size_t>(bit_width(spent), buckets - 1)], 1);
+    }
+
+    static void count(const Ticket& ticket) {
+        if (!enabled()) return;
+        Block& b = local();
+        bump(b.airlines[ticket.airline], 1);
+        bump(b.seats[ticket.seat], 1);
+    }
+    template <class Batch>
+    static void count(const Batch& batch) {
+        if (!enabled()) return;
+        Block& b = local();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            bump(b.airlines[batch.airline[i]], 1);
+            bump(b.seats[batch.seat[i]], 1);
+        }
+    }
+
+    // Everything counted so far on all threads as JSON, airline ids are named by names(id)
+    static void dump(ostream& out, const function<string(size_t)>& names);
+
+private:
+    struct Block {
+        atomic<uint64_t> calls[StageCount] = {};
+        atomic<uint64_t> ticks[StageCount] = {};
+        atomic<uint64_t> histogram[StageCount][buckets] = {};
+        atomic<uint64_t> airlines[256] = {};
+        atomic<uint64_t> seats[SeatCount] = {};
+        uint64_t mark = 0;
+    };
+
+    // Only the owning thread writes, so a relaxed load and store is enough and needs no lock
+    static void bump(atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    // Blocks live until exit so a finished worker's counts still show up in the dump
+    static Block& local() {
+        thread_local Block* block = [] {
+            lock_guard<mutex> lock(blocksLock);
+            blocks.push_back(make_unique<Block>());
+            return blocks.back().get();
+        }();
+        return *block;
+    }
+
+    static inline atomic<bool> on{false};
+    static inline uint64_t clockStart = 0;
+    static inline chrono::steady_clock::time_point wallStart;
+    static inline mutex blocksLock;
+    static inline vector<unique_ptr<Block>> blocks;
+};
+
+// s as a JSON string literal
+static void write_json_string(ostream& out, string_view s) {
+    static const char hex[] = "0123456789abcdef";
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20) out << "\\u00" << hex[c >> 4] << hex[c & 15];
+        else out << c;
+    }
+    out << '"';
+}
+
+void Telemetry::dump(ostream& out, const function<string(size_t)>& names) {
+    static const char* stageNames[StageCount] = {"parse", "dispatch", "price", "format"};
+    static const char* seatNames[SeatCount] = {"Economy", "Premium", "Business"};
+    double elapsedNs = chrono::duration<double, nano>(chrono::steady_clock::now() - wallStart).count();
+    double ticksPerNs = max(ticks() - clockStart, uint64_t(1)) / max(elapsedNs, 1.0);
+
+    lock_guard<mutex> lock(blocksLock);
+    auto total = [&](auto field) {
+        uint64_t sum = 0;
+        for (const auto& b : blocks) sum += field(*b).load(memory_order_relaxed);
+        return sum;
+    };
+    out << "{\n  \"threads\": " << blocks.size() << ",\n  \"ticks_per_ns\": " << ticksPerNs << ",\n  \"stages\": {";
+    for (size_t s = 0; s < StageCount; ++s) {
+        uint64_t ticksSpent = total([s](Block& b) -> atomic<uint64_t>& { return b.ticks[s]; });
+        out << (s ? "," : "") << "\n    \"" << stageNames[s] << "\": {\"calls\": "
+            << total([s](Block& b) -> atomic<uint64_t>& { return b.calls[s]; }) << ", \"ticks\": " << ticksSpent
+            << ", \"ns\": " << uint64_t(ticksSpent / ticksPerNs) << ", \"histogram\": [";
+        bool first = true;
+        for (size_t k = 0; k < buckets; ++k) {
+            uint64_t n = total([s, k](Block& b) -> atomic<uint64_t>& { return b.histogram[s][k]; });
+            if (!n) continue;
+            // bucket k holds calls that took less than 2^k ticks
+            out << (first ? "" : ", ") << "{\"le_ns\": " << uint64_t(ldexp(1.0, k) / ticksPerNs) << ", \"count\": " << n << "}";
+            first = false;
+        }
+        out << "]}";
+    }
+    out << "\n  },\n  \"airlines\": {";
+    bool first = true;
+    for (size_t a = 0; a < 256; ++a) {
+        uint64_t n = total([a](Block& b) -> atomic<uint64_t>& { return b.airlines[a]; });
+        if (!n) continue;
+        out << (first ? "" : ",") << "\n    ";
+        write_json_string(out, names(a));
+        out << ": " << n;
+        first = false;
+    }
+    out << "\n  },\n  \"seats\": {";
+    for (size_t s = 0; s < SeatCount; ++s) {
+        out << (s ? "," : "") << "\n    \"" << seatNames[s] << "\": "
+            << total([s](Block& b) -> atomic<uint64_t>& { return b.seats[s]; });
+    }
+    out << "\n  }\n}" << endl;
+}
+
+// Scratch memory for the temporaries of one batch. Every thread has its own, and reset()
+// at the start of a batch hands the same memory out again, so batch after batch nothing
+// is allocated. A batch that needs more than capacity gets it from the heap.
+class BatchArena {
+public:
+    static pmr::memory_resource* get() { return &local().resource; }
+    static void reset() { local().resource.release(); }
+
+private:
+    static constexpr size_t capacity = 256 << 10;
+
+    struct Arena {
+        vector<byte> buffer = vector<byte>(capacity);
+        pmr::monotonic_buffer_resource resource{buffer.data(), buffer.size()};
+    };
+
+    static Arena& local() {
+        thread_local Arena arena;
+        return arena;
+    }
+};
+
+static void price_batch_scalar(const PriceLine* lines, const float* distance, const uint8_t* airline,
+                               const uint8_t* seat, size_t n, float* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const PriceLine& line = lines[airline[i] * SeatCount + seat[i]];
+        out[i] = min(max(fma(line.slope, distance[i], line.intercept), line.floor), line.ceiling);
+    }
+}
+
+#if defined(__x86_64__)
+// Eight tickets per step: the coefficients of each lane's (airline, seat) are gathered
+// from the tariff lines, then one fma, max and min price all eight
+__attribute__((target("avx2,fma")))
+static void price_batch_avx2(const PriceLine* lines, const float* distance, const uint8_t* airline,
+                             const uint8_t* seat, size_t n, float* out) {
+    const float* table = &lines[0].slope;
+    const __m256i seatCount = _mm256_set1_epi32(SeatCount);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i air = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(airline + i)));
+        __m256i cls = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(seat + i)));
+        // offset of the lane's PriceLine, counted in floats
+        __m256i key = _mm256_slli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(air, seatCount), cls), 2);
+        __m256 slope = _mm256_i32gather_ps(table, key, 4);
+        __m256 intercept = _mm256_i32gather_ps(table + 1, key, 4);
+        __m256 floor = _mm256_i32gather_ps(table + 2, key, 4);
+        __m256 ceiling = _mm256_i32gather_ps(table + 3, key, 4);
+        __m256 price = _mm256_fmadd_ps(slope, _mm256_loadu_ps(distance + i), intercept);
+        price = _mm256_min_ps(_mm256_max_ps(price, floor), ceiling);
+        _mm256_storeu_ps(out + i, price);
+    }
+    price_batch_scalar(lines, distance + i, airline + i, seat + i, n - i, out + i);
+}
+#endif
+
+// Reprices the tickets whose (airline, seat) has a formula. Tickets are bucketed by program
+// so every program runs over blocks of its own tickets only.
+static void price_formulas(const TariffTable& tariffs, TicketColumns batch, float* out) {
+    const vector<FormulaProgram>& programs = tariffs.programs();
+    size_t n = batch.size;
+    pmr::vector<int16_t> programOf(n, BatchArena::get());
+    pmr::vector<uint32_t> starts(programs.size() + 1, 0, BatchArena::get());
+    for (size_t i = 0; i < n; ++i) {
+        programOf[i] = tariffs.formula(batch.airline[i], batch.seat[i]);
+        if (programOf[i] >= 0) ++starts[programOf[i] + 1];
+    }
+    for (size_t p = 0; p < programs.size(); ++p) starts[p + 1] += starts[p];
+    pmr::vector<uint32_t> fill(starts.begin(), starts.end() - 1, BatchArena::get());
+    pmr::vector<uint32_t> tickets(starts.back(), BatchArena::get());
+    for (size_t i = 0; i < n; ++i) {
+        if (programOf[i] >= 0) tickets[fill[programOf[i]]++] = i;
+    }
+
+    thread_local FormulaProgram::Registers regs;
+    for (size_t p = 0; p < programs.size(); ++p) {
+        for (size_t begin = starts[p]; begin < starts[p + 1]; begin += FormulaProgram::lanes) {
+            size_t m = min<size_t>(FormulaProgram::lanes, starts[p + 1] - begin);
+            for (size_t j = 0; j < m; ++j) {
+                uint32_t i = tickets[begin + j];
+                float miles = batch.distance[i];
+                uint8_t seat = batch.seat[i];
+                regs[FormulaProgram::Miles][j] = miles;
+                regs[FormulaProgram::OpCost][j] = tariffs.opCost(seat, miles);
+                regs[FormulaProgram::IsEconomy][j] = seat == Economy;
+                regs[FormulaProgram::IsPremium][j] = seat == Premium;
+                regs[FormulaProgram::IsBusiness][j] = seat == Business;
+            }
+            programs[p].run(regs, m);
+            const float* price = regs[programs[p].result()];
+            for (size_t j = 0; j < m; ++j) out[tickets[begin + j]] = price[j];
+        }
+    }
+}
+
+// Writes one price per ticket of the batch to out, airline ids index the tariff table
+static void price_batch(const TariffTable& tariffs, TicketColumns batch, float* out) {
+    BatchArena::reset();
+    bool done = false;
+#if defined(__x86_64__)
+    static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (avx2) {
+        price_batch_avx2(tariffs.data(), batch.distance, batch.airline, batch.seat, batch.size, out);
+        done = true;
+    }
+#endif
+    if (!done) price_batch_scalar(tariffs.data(), batch.distance, batch.airline, batch.seat, batch.size, out);
+    if (!tariffs.programs().empty()) price_formulas(tariffs, batch, out);
+}
+
+// The integer engine (--engine cents). Distances are parsed into thousandths of a mile and
+// prices come out in int64 cents: the mileage part is slope * distance rounded half up to
+// the cent, then the intercept is added and the result clamped. Nothing in it is floating
+// point, so prices are the same on every compiler, CPU and thread count. A distance with
+// up to three decimals is taken exactly and only the price is rounded; one with more is
+// first rounded half up to the thousandth of a mile.
+struct CentsLine {
+    int64_t slope;  // hundredths of a cent per mile, below 2^31
+    int64_t intercept;
+    int64_t floor;
+    int64_t ceiling;
+};
+
+// The clamped lines of a tariff table in integers. Airlines priced by a formula still go
+// through the float interpreter, their price is rounded to the cent afterwards.
+class CentsTable {
+public:
+    static bool from(const TariffTable& tariffs, CentsTable& table, string& error) {
+        constexpr double maxCents = 1e15;
+        table.source = &tariffs;
+        table.lines.assign(tariffs.size() * SeatCount, CentsLine{0, 0, 0, 0});
+        for (size_t id = 0; id < tariffs.size(); ++id) {
+            for (size_t seat = 0; seat < SeatCount; ++seat) {
+                if (tariffs.formula(id, seat) >= 0) continue;
+                const PriceLine& line = tariffs.data()[id * SeatCount + seat];
+                double slope = nearbyint(double(line.slope) * 10000);
+                double intercept = nearbyint(double(line.intercept) * 100);
+                if (!(slope >= 0 && slope < 2147483648.0) || !(fabs(intercept) < maxCents)) {
+                    error = tariffs.name(id) + ": rates must be between 0 and 214748 per mile, amounts below 1e13";
+                    return false;
+                }
+                CentsLine& cents = table.lines[id * SeatCount + seat];
+                cents.slope = slope;
+                cents.intercept = intercept;
+                cents.floor = line.floor == -noLimit ? numeric_limits<int64_t>::min()
+                                                     : int64_t(clamp(nearbyint(double(line.floor) * 100), -maxCents, maxCents));
+                cents.ceiling = line.ceiling == noLimit ? numeric_limits<int64_t>::max()
+                                                        : int64_t(clamp(nearbyint(double(line.ceiling) * 100), -maxCents, maxCents));
+            }
+        }
+        return true;
+    }
+
+    const TariffTable& tariffs() const { return *source; }
+    const CentsLine* data() const { return lines.data(); }
+
+private:
+    const TariffTable* source = nullptr;
+    vector<CentsLine> lines;
+};
+
+struct CentsBatch {
+    vector<uint32_t> distance;  // thousandths of a mile
+    vector<uint8_t> airline;
+    vector<uint8_t> seat;
+
+    size_t size() const { return distance.size(); }
+    void reserve(size_t n) {
+        distance.reserve(n);
+        airline.reserve(n);
+        seat.reserve(n);
+    }
+    void clear() {
+        distance.clear();
+        airline.clear();
+        seat.clear();
+    }
+};
+
+
+static ParseError add_to_batch(const TariffTable& tariffs, CentsBatch& batch, string_view s) {
+    string_view airline = next_token(s);
+    string_view distance = next_token(s);
+    string_view seat = next_token(s);
+    if (seat.empty() || !next_token(s).empty()) return ParseError::Fields;
+    int id = tariffs.find(airline);
+    if (id < 0) return ParseError::Airline;
+    uint32_t miles;
+    if (!parse_millimiles(distance, miles)) return ParseError::Distance;
+    Seat cls;
+    if (!parse_seat(seat, cls)) return ParseError::Seat;
+    batch.distance.push_back(miles);
+    batch.airline.push_back(id);
+    batch.seat.push_back(cls);
+    return ParseError::None;
+}
+
+static inline int64_t price_cents(const CentsLine& line, uint32_t distance) {
+    int64_t miles = (static_cast<uint64_t>(line.slope) * distance + 50000) / 100000;
+    return min(max(miles + line.intercept, line.floor), line.ceiling);
+}
+
+static void price_cents_scalar(const CentsLine* lines, const uint32_t* distance, const uint8_t* airline,
+                               const uint8_t* seat, size_t n, int64_t* out) {
+    for (size_t i = 0; i < n; ++i) out[i] = price_cents(lines[airline[i] * SeatCount + seat[i]], distance[i]);
+}
+
+#if defined(__x86_64__)
+// Four tickets per step, one per 64 bit lane. slope * distance is a 32 x 32 bit multiply;
+// dividing it by 100000 is the high half of a multiply by 0x29F16B11C6D1E109 shifted right
+// by 14, which AVX2 has no instruction for, so it is put together from four 32 bit ones.
+__attribute__((target("avx2")))
+static void price_cents_avx2(const CentsLine* lines, const uint32_t* distance, const uint8_t* airline,
+                             const uint8_t* seat, size_t n, int64_t* out) {
+    const __m256i half = _mm256_set1_epi64x(50000);
+    const __m256i magicLow = _mm256_set1_epi64x(0xC6D1E109);
+    const __m256i magicHigh = _mm256_set1_epi64x(0x29F16B11);
+    const __m256i low32 = _mm256_set1_epi64x(0xFFFFFFFF);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // a CentsLine is one register: load the four lanes' lines and transpose them
+        const __m256i* line = reinterpret_cast<const __m256i*>(lines);
+        __m256i l0 = _mm256_loadu_si256(line + airline[i] * SeatCount + seat[i]);
+        __m256i l1 = _mm256_loadu_si256(line + airline[i + 1] * SeatCount + seat[i + 1]);
+        __m256i l2 = _mm256_loadu_si256(line + airline[i + 2] * SeatCount + seat[i + 2]);
+        __m256i l3 = _mm256_loadu_si256(line + airline[i + 3] * SeatCount + seat[i + 3]);
+        __m256i t0 = _mm256_unpacklo_epi64(l0, l1), t1 = _mm256_unpackhi_epi64(l0, l1);
+        __m256i t2 = _mm256_unpacklo_epi64(l2, l3), t3 = _mm256_unpackhi_epi64(l2, l3);
+        __m256i slope = _mm256_permute2x128_si256(t0, t2, 0x20);
+        __m256i intercept = _mm256_permute2x128_si256(t1, t3, 0x20);
+        __m256i floor = _mm256_permute2x128_si256(t0, t2, 0x31);
+        __m256i ceiling = _mm256_permute2x128_si256(t1, t3, 0x31);
+        __m256i miles = _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(distance + i)));
+        __m256i x = _mm256_add_epi64(_mm256_mul_epu32(slope, miles), half);
+        __m256i xHigh = _mm256_srli_epi64(x, 32);
+        __m256i ll = _mm256_mul_epu32(x, magicLow);
+        __m256i lh = _mm256_mul_epu32(x, magicHigh);
+        __m256i hl = _mm256_mul_epu32(xHigh, magicLow);
+        __m256i hh = _mm256_mul_epu32(xHigh, magicHigh);
+        __m256i mid = _mm256_add_epi64(_mm256_add_epi64(_mm256_srli_epi64(ll, 32), _mm256_and_si256(lh, low32)),
+                                       _mm256_and_si256(hl, low32));
+        __m256i high = _mm256_add_epi64(_mm256_add_epi64(hh, _mm256_srli_epi64(lh, 32)),
+                                        _mm256_add_epi64(_mm256_srli_epi64(hl, 32), _mm256_srli_epi64(mid, 32)));
+        __m256i price = _mm256_add_epi64(_mm256_srli_epi64(high, 14), intercept);
+        price = _mm256_blendv_epi8(price, floor, _mm256_cmpgt_epi64(floor, price));
+        price = _mm256_blendv_epi8(price, ceiling, _mm256_cmpgt_epi64(price, ceiling));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), price);
+    }
+    price_cents_scalar(lines, distance + i, airline + i, seat + i, n - i, out + i);
+}
+#endif
+
+// Same as price_batch, in cents
+static void price_batch(const CentsTable& table, const CentsBatch& batch, int64_t* out) {
+    BatchArena::reset();
+    size_t n = batch.size();
+    bool done = false;
+#if defined(__x86_64__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        price_cents_avx2(table.data(), batch.distance.data(), batch.airline.data(), batch.seat.data(), n, out);
+        done = true;
+    }
+#endif
+    if (!done) price_cents_scalar(table.data(), batch.distance.data(), batch.airline.data(), batch.seat.data(), n, out);
+
+    const TariffTable& tariffs = table.tariffs();
+    if (tariffs.programs().empty()) return;
+    pmr::vector<float> miles(n, BatchArena::get()), prices(n, BatchArena::get());
+    for (size_t i = 0; i < n; ++i) miles[i] = batch.distance[i] / 1000.f;
+    price_formulas(tariffs, TicketColumns(miles.data(), batch.airline.data(), batch.seat.data(), n), prices.data());
+    for (size_t i = 0; i < n; ++i) {
+        if (tariffs.formula(batch.airline[i], batch.seat[i]) < 0) continue;
+        // float * 100 is exact in a double, so this is the cent float output would print
+        double cents = nearbyint(double(prices[i]) * 100);
+        out[i] = cents >= -9e18 && cents <= 9e18 ? int64_t(cents) : cents < 0 ? numeric_limits<int64_t>::min()
+                                                                              : numeric_limits<int64_t>::max();
+    }
+}
+
+// Which airlines are cheapest for a distance and seat class, without pricing every airline.
+// A clamped line is piecewise linear in miles, so between two consecutive breakpoints (a
+// line meeting its floor or ceiling, or two pieces of different airlines crossing) the
+// order of all airlines stays the same. The index keeps, per seat class, the sorted
+// breakpoints and the maxK cheapest airlines of each interval between them; a query is a
+// binary search. Airlines priced by a formula are evaluated on every query and merged in.
+class CarrierIndex {
+public:
+    static constexpr size_t maxK = 8;
+
+    struct Quote {
+        uint8_t airline;
+        float price;
+    };
+
+    explicit CarrierIndex(const TariffTable& tariffs) : tariffs(tariffs) {
+        for (size_t seat = 0; seat < SeatCount; ++seat) build(seat);
+        for (size_t id = 0; id < tariffs.size(); ++id) {
+            for (size_t seat = 0; seat < SeatCount; ++seat) {
+                int program = tariffs.formula(id, seat);
+                if (program < 0) continue;
+                if (find(formulas.begin(), formulas.end(), make_pair(uint8_t(id), program)) == formulas.end()) {
+                    formulas.emplace_back(id, program);
+                }
+            }
+        }
+    }
+
+    // Intervals between breakpoints in the index of a seat class
+    size_t intervals(Seat seat) const { return envelopes[seat].starts.size(); }
+
+    // Writes the k cheapest airlines for miles in seat to out, cheapest first, and returns
+    // how many there were. k is at most maxK.
+    size_t top(Seat seat, float miles, size_t k, Quote* out) const {
+        k = min(k, maxK);
+        Quote found[maxK * 2];
+        size_t n = ranked(seat, miles, k, found);
+        for (auto [id, program] : formulas) {
+            if (tariffs.formula(id, seat) != program) continue;
+            Quote q{id, evaluate(program, seat, miles)};
+            // insertion into the k best, formula quotes are few
+            size_t at = n;
+            while (at > 0 && q.price < found[at - 1].price) --at;
+            if (at >= k) continue;
+            n = min(n + 1, k);
+            move_backward(found + at, found + n - 1, found + n);
+            found[at] = q;
+        }
+        copy(found, found + n, out);
+        return n;
+    }
+
+    Quote cheapest(Seat seat, float miles) const {
+        Quote q{0, numeric_limits<float>::infinity()};
+        top(seat, miles, 1, &q);
+        return q;
+    }
+
+    // The cheapest airline for each of n queries. Formula airlines run once per block of
+    // queries rather than once per query.
+    void cheapest(const float* miles, const uint8_t* seat, size_t n, Quote* out) const {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = Quote{0, numeric_limits<float>::infinity()};
+            ranked(static_cast<Seat>(seat[i]), miles[i], 1, &out[i]);
+        }
+        if (formulas.empty()) return;
+        thread_local FormulaProgram::Registers regs;
+        for (size_t begin = 0; begin < n; begin += FormulaProgram::lanes) {
+            size_t m = min<size_t>(FormulaProgram::lanes, n - begin);
+            for (auto [id, program] : formulas) {
+                fill_inputs(regs, miles + begin, seat + begin, m);
+                tariffs.programs()[program].run(regs, m);
+                const float* price = regs[tariffs.programs()[program].result()];
+                for (size_t j = 0; j < m; ++j) {
+                    Quote& q = out[begin + j];
+                    if (tariffs.formula(id, seat[begin + j]) == program && price[j] < q.price) q = Quote{id, price[j]};
+                }
+            }
+        }
+    }
+
+private:
+    struct Envelope {
+        vector<double> starts;   // first mile of each interval, ascending from 0
+        vector<uint8_t> ranks;   // width airlines per interval, cheapest first
+        size_t width = 0;
+    };
+
+    void build(size_t seat) {
+        vector<uint8_t> ids;
+        for (size_t id = 0; id < tariffs.size(); ++id) {
+            if (tariffs.formula(id, seat) < 0) ids.push_back(id);
+        }
+        Envelope& e = envelopes[seat];
+        e.width = min(maxK, ids.size());
+        if (ids.empty()) return;
+
+        // every piece is a*x + b, a constant floor or ceiling being a = 0
+        struct Piece {
+            double a, b;
+        };
+        vector<Piece> pieces;
+        vector<double> breaks{0};
+        auto keep = [&breaks](double x) {
+            if (x > 0 && isfinite(x)) breaks.push_back(x);
+        };
+        for (uint8_t id : ids) {
+            const PriceLine& l = tariffs.data()[id * SeatCount + seat];
+            pieces.push_back(Piece{l.slope, l.intercept});
+            for (double limit : {double(l.floor), double(l.ceiling)}) {
+                if (!isfinite(limit)) continue;
+                pieces.push_back(Piece{0, limit});
+                if (l.slope != 0) keep((limit - l.intercept) / l.slope);
+            }
+        }
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            for (size_t j = i + 1; j < pieces.size(); ++j) {
+                if (pieces[i].a != pieces[j].a) keep((pieces[j].b - pieces[i].b) / (pieces[i].a - pieces[j].a));
+            }
+        }
+        sort(breaks.begin(), breaks.end());
+        breaks.erase(unique(breaks.begin(), breaks.end()), breaks.end());
+
+        // rank the airlines inside each interval, neighbours with the same top width merge
+        vector<uint8_t> order(ids);
+        for (size_t i = 0; i < breaks.size(); ++i) {
+            double x = i + 1 < breaks.size() ? (breaks[i] + breaks[i + 1]) / 2 : breaks[i] * 2 + 1;
+            auto price = [&](uint8_t id) {
+                const PriceLine& l = tariffs.data()[id * SeatCount + seat];
+                return min(max(double(l.slope) * x + l.intercept, double(l.floor)), double(l.ceiling));
+            };
+            stable_sort(order.begin(), order.end(), [&](uint8_t a, uint8_t b) { return price(a) < price(b); });
+            if (!e.starts.empty() && equal(order.begin(), order.begin() + e.width, e.ranks.end() - e.width)) continue;
+            e.starts.push_back(breaks[i]);
+            e.ranks.insert(e.ranks.end(), order.begin(), order.begin() + e.width);
+        }
+    }
+
+    // The k cheapest clamped line airlines, priced the way price_batch prices them
+    size_t ranked(Seat seat, float miles, size_t k, Quote* out) const {
+        const Envelope& e = envelopes[seat];
+        if (e.starts.empty()) return 0;
+        size_t interval = upper_bound(e.starts.begin(), e.starts.end(), double(miles)) - e.starts.begin();
+        const uint8_t* ranks = e.ranks.data() + (max<size_t>(interval, 1) - 1) * e.width;
+        k = min(k, e.width);
+        for (size_t i = 0; i < k; ++i) {
+            const PriceLine& l = tariffs.data()[ranks[i] * SeatCount + seat];
+            out[i] = Quote{ranks[i], min(max(fma(l.slope, miles, l.intercept), l.floor), l.ceiling)};
+        }
+        return k;
+    }
+
+    void fill_inputs(FormulaProgram::Registers& regs, const float* miles, const uint8_t* seat, size_t m) const {
+        for (size_t j = 0; j < m; ++j) {
+            regs[FormulaProgram::Miles][j] = miles[j];
+            regs[FormulaProgram::OpCost][j] = tariffs.opCost(seat[j], miles[j]);
+            regs[FormulaProgram::IsEconomy][j] = seat[j] == Economy;
+            regs[FormulaProgram::IsPremium][j] = seat[j] == Premium;
+            regs[FormulaProgram::IsBusiness][j] = seat[j] == Business;
+        }
+    }
+
+    float evaluate(int program, Seat seat, float miles) const {
+        thread_local FormulaProgram::Registers regs;
+        uint8_t cls = seat;
+        fill_inputs(regs, &miles, &cls, 1);
+        tariffs.programs()[program].run(regs, 1);
+        return regs[tariffs.programs()[program].result()][0];
+    }
+
+    const TariffTable& tariffs;
+    Envelope envelopes[SeatCount];
+    vector<pair<uint8_t, int>> formulas;  // (airline, program) pairs that are not clamped lines
+};
+
+// Read-only view of a whole input file, the ticket lines are sliced straight out of the mapping
+class MappedFile {
+public:
+    explicit MappedFile(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            len = st.st_size;
+            mapped = len == 0;  // an empty file is valid, there is just nothing to map
+            void* p = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            if (p != MAP_FAILED) {
+                addr = static_cast<char*>(p);
+                mapped = true;
+                madvise(addr, len, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (addr) munmap(addr, len);
+    }
+    MappedFile(const MappedFile&) = delete;
+    void operator=(const MappedFile&) = delete;
+
+    bool ok() const { return mapped; }
+    string_view view() const { return string_view(addr, len); }
+
+    // Give the pages before offset back to the kernel, they have already been priced
+    void release(size_t offset) const {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t end = offset / page * page;
+        if (addr && end > 0) madvise(addr, end, MADV_DONTNEED);
+    }
+
+private:
+    char* addr = nullptr;
+    size_t len = 0;
+    bool mapped = false;
+};
+
+// Calls f(line, next, number) for every line, empty ones included, so that every input line
+// gets an answer. next is the offset the following line starts at, number counts from 1.
+template <typename F>
+void for_each_line(string_view input, F&& f) {
+    size_t pos = 0;
+    size_t number = 0;
+    while (pos < input.size()) {
+        const char* nl = static_cast<const char*>(memchr(input.data() + pos, '\n', input.size() - pos));
+        size_t end = nl ? nl - input.data() : input.size();
+        string_view line = input.substr(pos, end - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        pos = end + 1;
+        f(line, pos, ++number);
+    }
+}
+
+static ParseError price_ticket(string_view line, float& cost) {
+    Telemetry::start();
+    Ticket ticket;
+    ParseError error = parse_ticket(line, ticket);
+    Telemetry::stop(Telemetry::Parse);
+    if (error != ParseError::None) return error;
+    Telemetry::count(ticket);
+    AirlineCalculator* clc = AirlineCalculator::create(ticket.airline);
+    Telemetry::stop(Telemetry::Dispatch);
+    cost = clc->calculate(ticket);
+    Telemetry::stop(Telemetry::Price);
+    return ParseError::None;
+}
+ 
+// unordered_map<string, AirlineCalculator*> airclcs{{"Delta",DeltaCalculator::instance()}, {"United",UnitedCalculator::instance()}, {"SouthWest",SouthwestCalculator::instance()}};
+
+// One cost per ticket. Rejected tickets cost NaN, and are appended to errors when it is given.
+vector<float> process_tickets(const vector<string>& tickets, vector<LineError>* errors = nullptr){
+    vector<float> costs(tickets.size(), numeric_limits<float>::quiet_NaN());
+    for(size_t i = 0; i < tickets.size(); ++i) {
+        ParseError error = price_ticket(tickets[i], costs[i]);
+        if (error != ParseError::None && errors) errors->push_back(LineError{i + 1, error});
+    }
+    return costs;
+}
+
+// Lines are parsed into a batch this big, which is priced in one go before the next is parsed
+constexpr size_t batchSize = 4096;
+
+static ParseError add_to_batch(const TariffTable& tariffs, TicketBatch& batch, string_view line) {
+    Ticket ticket;
+    ParseError error = parse_ticket(line, tariffs, ticket);
+    if (error == ParseError::None) batch.push_back(ticket);
+    return error;
+}
+
+// Prices what has been parsed since the last flush, the parse stage is timed up to here
+static void flush_batch(const TariffTable& tariffs, TicketBatch& batch, vector<float>& costs) {
+    Telemetry::stop(Telemetry::Parse);
+    Telemetry::count(batch);
+    size_t base = costs.size();
+    costs.resize(base + batch.size());
+    price_batch(tariffs, batch, costs.data() + base);
+    batch.clear();
+    Telemetry::stop(Telemetry::Price);
+}
+
+// About how many lines input holds, going by the lines of its first 64 KB. Counting them all
+// would read in every page of a mapped file before the first line is priced.
+static size_t estimate_lines(string_view input) {
+    string_view sample = input.substr(0, 1 << 16);
+    size_t lines = count(sample.begin(), sample.end(), '\n') + 1;
+    if (sample.size() == input.size()) return lines;
+    size_t estimate = input.size() / max<size_t>(sample.size() / lines, 1);
+    return estimate + estimate / 8;
+}
+
+// Gives the part of a mapped input that has been priced back to the kernel every 64 MB,
+// so resident memory stays bounded however big the file is. Does nothing without a file.
+class PageReleaser {
+public:
+    explicit PageReleaser(const MappedFile* file) : file(file) {}
+
+    void passed(size_t offset) {
+        constexpr size_t releaseEvery = 64 << 20;
+        if (!file || offset - released < releaseEvery) return;
+        file->release(offset);
+        released = offset;
+    }
+
+private:
+    const MappedFile* file;
+    size_t released = 0;
+};
+
+static vector<float> price_text(string_view input, const TariffTable& tariffs, vector<LineError>* errors,
+                                PageReleaser pages) {
+    vector<float> costs;
+    costs.reserve(estimate_lines(input));
+    TicketBatch batch;
+    batch.reserve(batchSize);
+    Telemetry::start();
+    for_each_line(input, [&](string_view line, size_t next, size_t number) {
+        ParseError error = add_to_batch(tariffs, batch, line);
+        if (error != ParseError::None && errors) errors->push_back(LineError{number, error});
+        if (batch.size() == batchSize) flush_batch(tariffs, batch, costs);
+        pages.passed(next);
+    });
+    flush_batch(tariffs, batch, costs);
+    return costs;
+}
+
+// Prices newline separated tickets without copying them, one float per line is the only allocation.
+// Rejected lines get no cost, they are appended to errors instead when it is given.
+vector<float> process_tickets(string_view input, const TariffTable& tariffs = TariffTable::builtin(),
+                              vector<LineError>* errors = nullptr){
+    return price_text(input, tariffs, errors, PageReleaser(nullptr));
+}
+
+vector<float> process_tickets(const MappedFile& file, const TariffTable& tariffs = TariffTable::builtin(),
+                              vector<LineError>* errors = nullptr){
+    return price_text(file.view(), tariffs, errors, PageReleaser(&file));
+}
+
+// Writes cents as fixed two decimal text ("152.50") and returns the end
+static char* format_cents(int64_t cents, char* out) {
+    uint64_t c = cents < 0 ? 0 - static_cast<uint64_t>(cents) : cents;
+    if (cents < 0) *out++ = '-';
+    char digits[24];
+    char* d = digits + sizeof(digits);
+    *--d = '0' + c % 10;
+    c /= 10;
+    *--d = '0' + c % 10;
+    c /= 10;
+    *--d = '.';
+    do {
+        *--d = '0' + c % 10;
+        c /= 10;
+    } while (c);
+    size_t len = digits + sizeof(digits) - d;
+    memcpy(out, d, len);
+    return out + len;
+}
+
+// Writes price as fixed two decimal text ("152.50") and returns the end. float * 100 is
+// exact in a double, so rounding that to even gives the same digits printf("%.2f") does.
+static char* format_price(float price, char* out) {
+    double cents = nearbyint(double(price) * 100);
+    if (!(fabs(cents) < 1e15)) {
+        return to_chars(out, out + 64, price, chars_format::fixed, 2).ptr;
+    }
+    // "-0.00" for small negative prices, as printf has it
+    if (signbit(price)) *out++ = '-';
+    return format_cents(static_cast<int64_t>(fabs(cents)), out);
+}
+
+// write(2) until everything is out, false with errno set if that fails
+static bool write_all(int fd, const char* data, size_t len) {
+    for (size_t done = 0; done < len;) {
+        ssize_t n = write(fd, data + done, len - done);
+        if (n > 0) done += n;
+        else if (n < 0 && errno != EINTR) return false;
+    }
+    return true;
+}
+
+// Calls onPrice(price) and onError(reason) in input line order. prices are the costs of the
+// lines that parsed, errors the other lines by number, sorted. line is the number of the first
+// line and is left at the number after the last.
+template <class Price, class OnPrice, class OnError>
+static void in_line_order(const vector<Price>& prices, const vector<LineError>& errors, size_t& line,
+                          OnPrice onPrice, OnError onError) {
+    auto e = errors.begin();
+    for (Price price : prices) {
+        for (; e != errors.end() && e->line == line; ++e, ++line) onError(e->reason);
+        onPrice(price);
+        ++line;
+    }
+    for (; e != errors.end(); ++e, ++line) onError(e->reason);
+}
+
+// Buffers formatted prices and hands the kernel one full buffer per write(2)
+class PriceWriter {
+public:
+    static constexpr size_t maxPrice = 64;
+
+    explicit PriceWriter(int fd, size_t capacity = 1 << 20) : fd(fd), buffer(capacity) {}
+    ~PriceWriter() { flush(); }
+    PriceWriter(const PriceWriter&) = delete;
+    void operator=(const PriceWriter&) = delete;
+
+    void put(float price) {
+        if (buffer.size() - used < maxPrice + 1) flush();
+        char* end = format_price(price, buffer.data() + used);
+        *end++ = '\n';
+        used = end - buffer.data();
+    }
+
+    void put(int64_t cents) {
+        if (buffer.size() - used < maxPrice + 1) flush();
+        char* end = format_cents(cents, buffer.data() + used);
+        *end++ = '\n';
+        used = end - buffer.data();
+    }
+
+    // "error: <reason>", the answer to a line that was rejected
+    void put_error(ParseError error) {
+        string_view reason = describe(error);
+        if (buffer.size() - used < reason.size() + 8) flush();
+        char* end = buffer.data() + used;
+        end = copy_n("error: ", 7, end);
+        end = copy(reason.begin(), reason.end(), end);
+        *end++ = '\n';
+        used = end - buffer.data();
+    }
+
+    template <class Price>
+    void put(const vector<Price>& prices) {
+        Telemetry::start();
+        for (Price price : prices) put(price);
+        Telemetry::stop(Telemetry::Format);
+    }
+
+    // One line per input line, errors in place of the prices of the lines they reject
+    template <class Price>
+    void put(const vector<Price>& prices, const vector<LineError>& errors) {
+        Telemetry::start();
+        size_t line = 1;
+        in_line_order(prices, errors, line, [this](Price price) { put(price); },
+                      [this](ParseError error) { put_error(error); });
+        Telemetry::stop(Telemetry::Format);
+    }
+
+    // False once a write has failed, errno tells why
+    bool flush() {
+        if (!failed && !write_all(fd, buffer.data(), used)) failed = true;
+        used = 0;
+        return !failed;
+    }
+
+    bool ok() const { return !failed; }
+
+private:
+    int fd;
+    vector<char> buffer;
+    size_t used = 0;
+    bool failed = false;
+};
+
+// Fixed set of workers, each owning a deque of tasks. A worker pops its own newest task
+// and, once its deque runs dry, steals the oldest task of another worker.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads) {
+        threads = max(threads, 1u);
+        for (unsigned i = 0; i < threads; ++i) queues.push_back(make_unique<Queue>());
+        // the thread calling parallel_for works as queue 0
+        for (unsigned i = 1; i < threads; ++i) workers.emplace_back([this, i] { work(i); });
+    }
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(m);
+            stop = true;
+        }
+        wake.notify_all();
+        for (thread& t : workers) t.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    void operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return queues.size(); }
+
+    // Runs task(i) for every i in [0, n) and returns once all of them have finished.
+    // One parallel_for at a time.
+    template <typename F>
+    void parallel_for(size_t n, F&& task) {
+        pending = n;
+        for (size_t i = 0; i < n; ++i) {
+            Queue& q = *queues[i % queues.size()];
+            lock_guard<mutex> lock(q.m);
+            q.tasks.push_back([&task, i] { task(i); });
+        }
+        {
+            lock_guard<mutex> lock(m);
+            queued += n;
+        }
+        wake.notify_all();
+        while (try_run(0)) {}
+        unique_lock<mutex> lock(m);
+        finished.wait(lock, [this] { return pending == 0; });
+    }
+
+private:
+    struct Queue {
+        mutex m;
+        deque<function<void()>> tasks;
+    };
+
+    bool try_run(unsigned self) {
+        function<void()> task;
+        for (size_t i = 0; i < queues.size() && !task; ++i) {
+            Queue& q = *queues[(self + i) % queues.size()];
+            lock_guard<mutex> lock(q.m);
+            if (q.tasks.empty()) continue;
+            if (i == 0) {
+                task = move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        --queued;
+        task();
+        if (--pending == 0) {
+            lock_guard<mutex> lock(m);
+            finished.notify_all();
+        }
+        return true;
+    }
+
+    void work(unsigned self) {
+        for (;;) {
+            if (try_run(self)) continue;
+            unique_lock<mutex> lock(m);
+            wake.wait(lock, [this] { return stop || queued > 0; });
+            if (stop) return;
+        }
+    }
+
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> workers;
+    mutex m;
+    condition_variable wake, finished;
+    atomic<size_t> queued{0}, pending{0};
+    bool stop = false;
+};
+
+// Cuts input into about n pieces that each end right after a newline
+static vector<string_view> split_lines(string_view input, size_t n) {
+    vector<string_view> chunks;
+    size_t target = max<size_t>(input.size() / max<size_t>(n, 1), 1);
+    size_t pos = 0;
+    while (pos < input.size()) {
+        size_t end = min(pos + target, input.size());
+        if (end < input.size()) {
+            end = input.find('\n', end);
+            end = end == string_view::npos ? input.size() : end + 1;
+        }
+        chunks.push_back(input.substr(pos, end - pos));
+        pos = end;
+    }
+    return chunks;
+}
+
+// Runs process(chunk, errors) over line aligned chunks of input on the pool and puts the
+// prices and the errors back together in input order, so the result is the same as the
+// serial process_tickets
+template <class Price, class Process>
+static vector<Price> process_chunks(string_view input, ThreadPool& pool, vector<LineError>* errors, Process process) {
+    constexpr size_t minChunk = 1 << 20;
+    size_t n = min<size_t>(pool.size() * 8, input.size() / minChunk + 1);
+    vector<string_view> chunks = split_lines(input, n);
+    vector<vector<Price>> parts(chunks.size());
+    // line numbers in partErrors start over in every chunk, newlines moves them along
+    vector<vector<LineError>> partErrors(chunks.size());
+    vector<size_t> newlines(chunks.size());
+    pool.parallel_for(chunks.size(), [&](size_t i) {
+        parts[i] = process(chunks[i], errors ? &partErrors[i] : nullptr);
+        if (errors) newlines[i] = count(chunks[i].begin(), chunks[i].end(), '\n');
+    });
+    if (errors) {
+        size_t first = 0;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            for (LineError e : partErrors[i]) errors->push_back(LineError{first + e.line, e.reason});
+            first += newlines[i];
+        }
+    }
+    size_t total = 0;
+    for (const vector<Price>& part : parts) total += part.size();
+    vector<Price> costs;
+    costs.reserve(total);
+    for (const vector<Price>& part : parts) costs.insert(costs.end(), part.begin(), part.end());
+    return costs;
+}
+
+vector<float> process_tickets(string_view input, ThreadPool& pool,
+                              const TariffTable& tariffs = TariffTable::builtin(),
+                              vector<LineError>* errors = nullptr){
+    return process_chunks<float>(input, pool, errors, [&](string_view chunk, vector<LineError>* chunkErrors) {
+        return process_tickets(chunk, tariffs, chunkErrors);
+    });
+}
+
+static void flush_batch(const CentsTable& table, CentsBatch& batch, vector<int64_t>& costs) {
+    Telemetry::stop(Telemetry::Parse);
+    Telemetry::count(batch);
+    size_t base = costs.size();
+    costs.resize(base + batch.size());
+    price_batch(table, batch, costs.data() + base);
+    batch.clear();
+    Telemetry::stop(Telemetry::Price);
+}
+
+static vector<int64_t> price_text(string_view input, const CentsTable& table, vector<LineError>* errors,
+                                  PageReleaser pages) {
+    vector<int64_t> costs;
+    costs.reserve(estimate_lines(input));
+    CentsBatch batch;
+    batch.reserve(batchSize);
+    Telemetry::start();
+    for_each_line(input, [&](string_view line, size_t next, size_t number) {
+        ParseError error = add_to_batch(table.tariffs(), batch, line);
+        if (error != ParseError::None && errors) errors->push_back(LineError{number, error});
+        if (batch.size() == batchSize) flush_batch(table, batch, costs);
+        pages.passed(next);
+    });
+    flush_batch(table, batch, costs);
+    return costs;
+}
+
+// process_tickets on the integer engine, one price in cents per good line
+vector<int64_t> process_tickets_cents(string_view input, const CentsTable& table, vector<LineError>* errors = nullptr) {
+    return price_text(input, table, errors, PageReleaser(nullptr));
+}
+
+vector<int64_t> process_tickets_cents(const MappedFile& file, const CentsTable& table,
+                                      vector<LineError>* errors = nullptr) {
+    return price_text(file.view(), table, errors, PageReleaser(&file));
+}
+
+vector<int64_t> process_tickets_cents(string_view input, ThreadPool& pool, const CentsTable& table,
+                                      vector<LineError>* errors = nullptr) {
+    return process_chunks<int64_t>(input, pool, errors, [&](string_view chunk, vector<LineError>* chunkErrors) {
+        return process_tickets_cents(chunk, table, chunkErrors);
+    });
+}
+
+// Input that cannot be mapped, a pipe or a terminal, is priced by three coroutines taking
+// turns on this thread: read -> parse and price -> format and write. They are joined by
+// small bounded channels, so memory stays flat and a slow reader of the output holds
+// back reading the input. Nothing waits for a full batch while more input is not there
+// yet, so the first price goes out as soon as the first line is in.
+
+// A coroutine run by a Scheduler. It starts suspended and stays suspended when it ends,
+// the scheduler destroys it.
+struct Job {
+    struct promise_type {
+        Job get_return_object() { return Job{coroutine_handle<promise_type>::from_promise(*this)}; }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+    coroutine_handle<promise_type> handle;
+};
+
+class Scheduler {
+public:
+    Scheduler() = default;
+    Scheduler(const Scheduler&) = delete;
+    void operator=(const Scheduler&) = delete;
+    ~Scheduler() {
+        for (coroutine_handle<> job : jobs) job.destroy();
+    }
+
+    void spawn(Job job) {
+        jobs.push_back(job.handle);
+        ready.push_back(job.handle);
+    }
+
+    void wake(coroutine_handle<> h) { ready.push_back(h); }
+
+    // co_await wait(fd, POLLIN or POLLOUT) resumes the caller once fd is ready for it
+    auto wait(int fd, short events) {
+        struct Awaiter {
+            Scheduler& scheduler;
+            pollfd fd;
+            bool await_ready() { return false; }
+            void await_suspend(coroutine_handle<> h) {
+                scheduler.polls.push_back(fd);
+                scheduler.pollers.push_back(h);
+            }
+            void await_resume() {}
+        };
+        return Awaiter{*this, pollfd{fd, events, 0}};
+    }
+
+    // Runs jobs until none can go on, true if they all finished
+    bool run() {
+        for (;;) {
+            // swapped out first, a job can wake another while it runs
+            while (!ready.empty()) {
+                running.swap(ready);
+                for (coroutine_handle<> h : running) h.resume();
+                running.clear();
+            }
+            if (polls.empty()) break;
+            if (::poll(polls.data(), polls.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            for (size_t i = 0; i < polls.size();) {
+                if (!polls[i].revents) {
+                    ++i;
+                    continue;
+                }
+                ready.push_back(pollers[i]);
+                polls[i] = polls.back();
+                pollers[i] = pollers.back();
+                polls.pop_back();
+                pollers.pop_back();
+            }
+        }
+        return all_of(jobs.begin(), jobs.end(), [](coroutine_handle<> job) { return job.done(); });
+    }
+
+private:
+    vector<coroutine_handle<>> jobs;
+    vector<coroutine_handle<>> ready, running;
+    vector<pollfd> polls;
+    vector<coroutine_handle<>> pollers;
+};
+
+// Bounded queue from one coroutine to another. push suspends the sender while the channel
+// is full, pop suspends the receiver while it is empty and gives nullopt once it is closed.
+template <class T>
+class Channel {
+public:
+    Channel(Scheduler& scheduler, size_t capacity) : scheduler(scheduler), slots(capacity) {}
+
+    bool empty() const { return count == 0; }
+
+    auto push(T item) {
+        struct Awaiter {
+            Channel& c;
+            T item;
+            bool await_ready() { return c.count < c.slots.size(); }
+            void await_suspend(coroutine_handle<> h) { c.sender = h; }
+            void await_resume() {
+                c.slots[(c.first + c.count++) % c.slots.size()] = move(item);
+                if (c.receiver) c.scheduler.wake(exchange(c.receiver, nullptr));
+            }
+        };
+        return Awaiter{*this, move(item)};
+    }
+
+    auto pop() {
+        struct Awaiter {
+            Channel& c;
+            bool await_ready() { return c.count || c.closed; }
+            void await_suspend(coroutine_handle<> h) { c.receiver = h; }
+            optional<T> await_resume() {
+                if (!c.count) return nullopt;
+                optional<T> item(move(c.slots[c.first]));
+                c.first = (c.first + 1) % c.slots.size();
+                --c.count;
+                if (c.sender) c.scheduler.wake(exchange(c.sender, nullptr));
+                return item;
+            }
+        };
+        return Awaiter{*this};
+    }
+
+    void close() {
+        closed = true;
+        if (receiver) scheduler.wake(exchange(receiver, nullptr));
+    }
+
+private:
+    Scheduler& scheduler;
+    vector<T> slots;  // a ring, count items from first on
+    size_t first = 0, count = 0;
+    coroutine_handle<> sender, receiver;
+    bool closed = false;
+};
+
+// What the pricing stage hands the writer: prices of the good lines, reasons for the others
+struct PricedLines {
+    vector<float> costs;
+    vector<LineError> errors;
+};
+
+// Chunks and priced batches go back to these once used and are filled again, so the
+// pipeline stops allocating once every stage has its buffers
+struct Spares {
+    vector<string> chunks;
+    vector<PricedLines> priced;
+};
+
+static Job read_stage(Scheduler& scheduler, int fd, Channel<string>& out, Spares& spares, bool& failed) {
+    constexpr size_t chunkSize = 1 << 16;
+    for (;;) {
+        co_await scheduler.wait(fd, POLLIN);
+        string chunk;
+        if (!spares.chunks.empty()) {
+            chunk = move(spares.chunks.back());
+            spares.chunks.pop_back();
+        }
+        chunk.resize(chunkSize);
+        ssize_t n = read(fd, chunk.data(), chunk.size());
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) {
+            failed = n < 0;
+            break;
+        }
+        chunk.resize(n);
+        co_await out.push(move(chunk));
+    }
+    out.close();
+}
+
+static Job price_stage(const TariffTable& tariffs, Channel<string>& in, Channel<PricedLines>& out, Spares& spares) {
+    TicketBatch batch;
+    batch.reserve(batchSize);
+    PricedLines priced;
+    auto next = [&] {
+        PricedLines fresh;
+        if (!spares.priced.empty()) {
+            fresh = move(spares.priced.back());
+            spares.priced.pop_back();
+            fresh.costs.clear();
+            fresh.errors.clear();
+        }
+        return fresh;
+    };
+    string carry;  // the start of a line the last chunk cut off
+    size_t lines = 0;
+    // telemetry restarts after every resume, so time spent suspended is not booked to a stage
+    auto flush = [&] { flush_batch(tariffs, batch, priced.costs); };
+    auto parse = [&](string_view text) {
+        for_each_line(text, [&](string_view line, size_t, size_t number) {
+            ParseError error = add_to_batch(tariffs, batch, line);
+            if (error != ParseError::None) priced.errors.push_back(LineError{lines + number, error});
+            if (batch.size() == batchSize) flush();
+        });
+        lines += count(text.begin(), text.end(), '\n');
+    };
+    while (optional<string> chunk = co_await in.pop()) {
+        Telemetry::start();
+        string_view data = *chunk;
+        if (!carry.empty()) {
+            size_t nl = data.find('\n');
+            carry.append(data.substr(0, nl == string_view::npos ? data.size() : nl + 1));
+            if (nl == string_view::npos) continue;
+            parse(carry);
+            carry.clear();
+            data.remove_prefix(nl + 1);
+        }
+        size_t complete = data.rfind('\n') + 1;
+        parse(data.substr(0, complete));
+        carry.assign(data.substr(complete));
+        spares.chunks.push_back(move(*chunk));
+        // more input is not there yet, so what is parsed goes out now rather than later
+        if (batch.size() + priced.costs.size() >= batchSize || in.empty()) {
+            flush();
+            if (!priced.costs.empty() || !priced.errors.empty()) co_await out.push(exchange(priced, next()));
+        }
+    }
+    Telemetry::start();
+    parse(carry);
+    flush();
+    if (!priced.costs.empty() || !priced.errors.empty()) co_await out.push(move(priced));
+    out.close();
+}
+
+// Pipes take at most PIPE_BUF bytes per wakeup so a write never blocks the other stages
+static Job write_stage(Scheduler& scheduler, Channel<PricedLines>& in, Spares& spares, int fd, int errFd,
+                       const char* name, bool& failed) {
+    constexpr size_t flushAt = 1 << 16;
+    struct stat st;
+    size_t step = fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)) ? PIPE_BUF : SIZE_MAX;
+    string buffer;
+    buffer.reserve(2 * flushAt);
+    char price[PriceWriter::maxPrice + 1];
+    size_t line = 1;
+    while (optional<PricedLines> priced = co_await in.pop()) {
+        if (!priced->errors.empty()) {
+            string report;
+            for (LineError e : priced->errors) {
+                report += name;
+                report += ":" + to_string(e.line) + ": " + describe(e.reason) + "\n";
+            }
+            write_all(errFd, report.data(), report.size());
+        }
+        Telemetry::start();
+        in_line_order(priced->costs, priced->errors, line,
+            [&](float cost) {
+                char* end = format_price(cost, price);
+                *end++ = '\n';
+                buffer.append(price, end);
+            },
+            [&](ParseError error) {
+                buffer += "error: ";
+                buffer += describe(error);
+                buffer += '\n';
+            });
+        Telemetry::stop(Telemetry::Format);
+        spares.priced.push_back(move(*priced));
+        if (buffer.size() < flushAt && !in.empty()) continue;
+        for (size_t done = 0; done < buffer.size() && !failed;) {
+            co_await scheduler.wait(fd, POLLOUT);
+            ssize_t n = write(fd, buffer.data() + done, min(step, buffer.size() - done));
+            if (n > 0) done += n;
+            else if (n < 0 && errno != EINTR && errno != EAGAIN) failed = true;
+        }
+        buffer.clear();
+    }
+}
+
+// Prices the tickets read from in as they come, costs to out and rejected lines to errFd
+static bool stream_tickets(int in, int out, int errFd, const char* name, const TariffTable& tariffs) {
+    Scheduler scheduler;
+    Channel<string> chunks(scheduler, 4);
+    Channel<PricedLines> priced(scheduler, 4);
+    Spares spares;
+    bool readFailed = false, writeFailed = false;
+    scheduler.spawn(read_stage(scheduler, in, chunks, spares, readFailed));
+    scheduler.spawn(price_stage(tariffs, chunks, priced, spares));
+    scheduler.spawn(write_stage(scheduler, priced, spares, out, errFd, name, writeFailed));
+    return scheduler.run() && !readFailed && !writeFailed;
+}
+
+// Tickets stored as columns so a set that gets re-priced over and over is parsed once.
+// Native byte order, laid out as
+//
+//   ColumnHeader
+//   airline names, each a length byte and the name, id order
+//   BlockStats[blocks]           when ColumnHeader::hasStats is set
+//   float distance[tickets]      64 byte aligned, like the two columns after it
+//   uint8_t airline[tickets]
+//   uint8_t seat[tickets]
+//
+// The columns can be priced straight out of a mapping of the file.
+struct ColumnHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t airlines;
+    uint64_t tickets;
+    uint32_t blockSize;
+    uint32_t hasStats;
+    uint64_t namesOffset;
+    uint64_t statsOffset;
+    uint64_t distanceOffset;
+    uint64_t airlineOffset;
+    uint64_t seatOffset;
+    uint64_t content;  // FNV-1a of the names and the three columns, stamped by write_columns
+    uint64_t reserved[2];
+};
+static_assert(sizeof(ColumnHeader) == 96);
+
+constexpr char columnMagic[8] = {'Z', 'O', 'O', 'X', 'C', 'O', 'L', '1'};
+
+// What is in each block of tickets, so a reader can skip the blocks it does not need
+struct BlockStats {
+    float minDistance;
+    float maxDistance;
+    uint64_t airlines[4];  // bit a is set when airline id a occurs in the block
+    bool has(size_t airline) const { return airlines[airline / 64] >> (airline % 64) & 1; }
+};
+
+static size_t align64(size_t offset) {
+    return (offset + 63) / 64 * 64;
+}
+
+// Converts a ticket text file. Names are resolved through tariffs, which become the name
+// dictionary. Rejected lines, empty ones included, are left out and appended to errors, as
+// every text path reports them.
+static bool write_columns(string_view input, const TariffTable& tariffs, const char* path, bool stats,
+                          vector<LineError>& errors, string& error) {
+    constexpr uint32_t blockSize = 65536;
+    // every line is at most one ticket, so sizing the columns for all of them is enough
+    size_t capacity = count(input.begin(), input.end(), '\n') + 1;
+    size_t blocks = (capacity + blockSize - 1) / blockSize;
+
+    ColumnHeader header = {};
+    memcpy(header.magic, columnMagic, sizeof(columnMagic));
+    header.version = 2;
+    header.airlines = tariffs.size();
+    header.blockSize = blockSize;
+    header.hasStats = stats;
+    header.namesOffset = sizeof(ColumnHeader);
+    size_t namesSize = 0;
+    for (size_t id = 0; id < tariffs.size(); ++id) namesSize += 1 + min<size_t>(tariffs.name(id).size(), 255);
+    header.statsOffset = align64(header.namesOffset + namesSize);
+    header.distanceOffset = align64(header.statsOffset + (stats ? blocks * sizeof(BlockStats) : 0));
+    header.airlineOffset = align64(header.distanceOffset + capacity * sizeof(float));
+    header.seatOffset = align64(header.airlineOffset + capacity);
+    size_t fileSize = header.seatOffset + capacity;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, fileSize) != 0) {
+        error = string(path) + ": " + strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        error = string(path) + ": " + strerror(errno);
+        return false;
+    }
+    char* base = static_cast<char*>(p);
+    float* distance = reinterpret_cast<float*>(base + header.distanceOffset);
+    uint8_t* airline = reinterpret_cast<uint8_t*>(base + header.airlineOffset);
+    uint8_t* seat = reinterpret_cast<uint8_t*>(base + header.seatOffset);
+
+    char* name = base + header.namesOffset;
+    for (size_t id = 0; id < tariffs.size(); ++id) {
+        size_t len = min<size_t>(tariffs.name(id).size(), 255);
+        *name++ = static_cast<char>(len);
+        memcpy(name, tariffs.name(id).data(), len);
+        name += len;
+    }
+
+    size_t n = 0;
+    for_each_line(input, [&](string_view line, size_t, size_t number) {
+        Ticket ticket;
+        ParseError reason = parse_ticket(line, tariffs, ticket);
+        if (reason != ParseError::None) {
+            errors.push_back(LineError{number, reason});
+            return;
+        }
+        distance[n] = ticket.distance;
+        airline[n] = ticket.airline;
+        seat[n] = ticket.seat;
+        ++n;
+    });
+    header.tickets = n;
+
+    if (stats) {
+        BlockStats* block = reinterpret_cast<BlockStats*>(base + header.statsOffset);
+        for (size_t b = 0; b * blockSize < n; ++b) {
+            BlockStats st = {noLimit, -noLimit, {}};
+            for (size_t i = b * blockSize; i < min<size_t>(n, (b + 1) * blockSize); ++i) {
+                st.minDistance = min(st.minDistance, distance[i]);
+                st.maxDistance = max(st.maxDistance, distance[i]);
+                st.airlines[airline[i] / 64] |= uint64_t(1) << (airline[i] % 64);
+            }
+            block[b] = st;
+        }
+    }
+    // hashed once here, so whoever keeps results for this file can tell it apart from a
+    // rebuilt one by the header alone
+    header.content = fnv1a(base + header.namesOffset, namesSize);
+    header.content = fnv1a(distance, n * sizeof(float), header.content);
+    header.content = fnv1a(airline, n, header.content);
+    header.content = fnv1a(seat, n, header.content);
+    memcpy(base, &header, sizeof(header));
+    bool synced = msync(base, fileSize, MS_SYNC) == 0;
+    munmap(base, fileSize);
+    if (!synced) error = string(path) + ": " + strerror(errno);
+    return synced;
+}
+
+// A mapped column file, checked once on open and read in place after that
+class ColumnFile {
+public:
+    static bool is_column_file(string_view data) {
+        return data.size() >= sizeof(ColumnHeader) && memcmp(data.data(), columnMagic, sizeof(columnMagic)) == 0;
+    }
+
+    // data has to stay mapped while the ColumnFile is used. Without checkIds only the header
+    // and names are checked, and check_ids has to pass before tickets are read.
+    bool open(string_view data, string& error, bool checkIds = true) {
+        if (!is_column_file(data)) {
+            error = "not a column file";
+            return false;
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        auto fits = [&](uint64_t offset, uint64_t size) { return offset <= data.size() && size <= data.size() - offset; };
+        size_t blocks = header.blockSize ? (header.tickets + header.blockSize - 1) / header.blockSize : 0;
+        if (header.version != 2) {
+            error = "column file version " + to_string(header.version) + ", convert the tickets again";
+            return false;
+        }
+        if (header.blockSize == 0 || header.airlines > TariffTable::maxAirlines ||
+            !fits(header.distanceOffset, header.tickets * sizeof(float)) || header.distanceOffset % 64 ||
+            !fits(header.airlineOffset, header.tickets) || !fits(header.seatOffset, header.tickets) ||
+            (header.hasStats && !fits(header.statsOffset, blocks * sizeof(BlockStats)))) {
+            error = "corrupt column file header";
+            return false;
+        }
+        names.clear();
+        size_t pos = header.namesOffset;
+        for (size_t id = 0; id < header.airlines; ++id) {
+            if (!fits(pos, 1) || !fits(pos + 1, static_cast<uint8_t>(data[pos]))) {
+                error = "corrupt column file names";
+                return false;
+            }
+            size_t len = static_cast<uint8_t>(data[pos]);
+            names.push_back(data.substr(pos + 1, len));
+            pos += 1 + len;
+        }
+        base = data.data();
+        return !checkIds || check_ids(error);
+    }
+
+    // every airline and seat id in range, one pass over both columns
+    bool check_ids(string& error) const {
+        const uint8_t* air = airlines();
+        const uint8_t* cls = seats();
+        for (size_t i = 0; i < header.tickets; ++i) {
+            if (air[i] >= header.airlines || cls[i] >= SeatCount) {
+                error = "corrupt column file, ticket " + to_string(i) + " has an id out of range";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t size() const { return header.tickets; }
+    size_t block_size() const { return header.blockSize; }
+    size_t blocks() const { return (header.tickets + header.blockSize - 1) / header.blockSize; }
+    const vector<string_view>& airline_names() const { return names; }
+    const float* distances() const { return reinterpret_cast<const float*>(base + header.distanceOffset); }
+    const uint8_t* airlines() const { return reinterpret_cast<const uint8_t*>(base + header.airlineOffset); }
+    const uint8_t* seats() const { return reinterpret_cast<const uint8_t*>(base + header.seatOffset); }
+    // nullptr when the file was written without statistics
+    const BlockStats* stats() const {
+        return header.hasStats ? reinterpret_cast<const BlockStats*>(base + header.statsOffset) : nullptr;
+    }
+
+    // Tickets [first, first + n) as columns
+    TicketColumns columns(size_t first, size_t n) const {
+        return TicketColumns(distances() + first, airlines() + first, seats() + first, n);
+    }
+
+    // Maps the file's airline ids onto ids of tariffs, false naming the first one it lacks
+    bool map_airlines(const TariffTable& tariffs, vector<uint8_t>& ids, string& error) const {
+        ids.resize(names.size());
+        for (size_t id = 0; id < names.size(); ++id) {
+            int mapped = tariffs.find(names[id]);
+            if (mapped < 0) {
+                error = "no tariff for airline " + string(names[id]);
+                return false;
+            }
+            ids[id] = mapped;
+        }
+        return true;
+    }
+
+private:
+    ColumnHeader header = {};
+    vector<string_view> names;
+    const char* base = nullptr;
+};
+
+// Prices a column file block by block. When the file's ids match the tariff table the
+// columns are priced in place, otherwise each block's airline ids are translated first.
+static bool process_columns(const ColumnFile& file, const TariffTable& tariffs, ThreadPool* pool,
+                            vector<float>& costs, string& error) {
+    vector<uint8_t> ids;
+    if (!file.map_airlines(tariffs, ids, error)) return false;
+    bool identity = true;
+    for (size_t id = 0; id < ids.size(); ++id) identity = identity && ids[id] == id;
+    costs.resize(file.size());
+    auto price_block = [&](size_t b) {
+        size_t first = b * file.block_size();
+        size_t n = min(file.block_size(), file.size() - first);
+        TicketColumns block = file.columns(first, n);
+        if (identity) {
+            price_batch(tariffs, block, costs.data() + first);
+            return;
+        }
+        thread_local vector<uint8_t> translated;
+        translated.resize(n);
+        for (size_t i = 0; i < n; ++i) translated[i] = ids[block.airline[i]];
+        block.airline = translated.data();
+        price_batch(tariffs, block, costs.data() + first);
+    };
+    if (pool) {
+        pool->parallel_for(file.blocks(), price_block);
+    } else {
+        for (size_t b = 0; b < file.blocks(); ++b) price_block(b);
+    }
+    return true;
+}
+
+// zoox shard: the coordinator cuts a ticket file into line aligned byte ranges and runs
+// one worker process per range (zoox shard-worker, the same binary), each pinned to its
+// own NUMA node or, on a single node machine, to its own slice of the cores. A worker
+// writes the prices of its range to a part file and its rejected lines to an error part
+// that starts with its line count, so the coordinator can number them without reading the
+// input. The parts are joined in range order, which gives exactly the serial output.
+// A worker that dies or fails is started again on its range, up to three times.
+
+// "0-3,8,10-11" as in /sys/devices/system/node/node*/cpulist
+static vector<int> parse_cpulist(string_view list) {
+    vector<int> cpus;
+    while (!list.empty()) {
+        size_t comma = min(list.find(','), list.size());
+        string_view item = list.substr(0, comma);
+        list.remove_prefix(min(comma + 1, list.size()));
+        int first = 0, last = 0;
+        auto [ptr, ec] = from_chars(item.data(), item.data() + item.size(), first);
+        last = first;
+        if (ec == errc() && ptr < item.data() + item.size() && *ptr == '-') {
+            from_chars(ptr + 1, item.data() + item.size(), last);
+        }
+        for (int cpu = first; ec == errc() && cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// The cores each of n workers is pinned to: whole NUMA nodes round robin when there is
+// more than one node, otherwise the cores this process may use cut into n slices
+static vector<cpu_set_t> worker_cpus(size_t n) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    vector<vector<int>> nodes;
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        while (dirent* entry = readdir(dir)) {
+            string_view name = entry->d_name;
+            if (name.substr(0, 4) != "node" || name.size() == 4 || !isdigit(static_cast<unsigned char>(name[4]))) continue;
+            ifstream file(string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+            string list;
+            getline(file, list);
+            vector<int> cpus;
+            for (int cpu : parse_cpulist(list)) {
+                if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+            }
+            if (!cpus.empty()) nodes.push_back(move(cpus));
+        }
+        closedir(dir);
+    }
+    vector<cpu_set_t> sets(n);
+    for (cpu_set_t& set : sets) CPU_ZERO(&set);
+    if (nodes.size() > 1) {
+        for (size_t i = 0; i < n; ++i) {
+            for (int cpu : nodes[i % nodes.size()]) CPU_SET(cpu, &sets[i]);
+        }
+        return sets;
+    }
+    vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    }
+    if (cpus.empty()) cpus.push_back(0);
+    for (size_t i = 0; i < n; ++i) {
+        if (n >= cpus.size()) {
+            CPU_SET(cpus[i % cpus.size()], &sets[i]);
+            continue;
+        }
+        for (size_t c = i * cpus.size() / n; c < (i + 1) * cpus.size() / n; ++c) CPU_SET(cpus[c], &sets[i]);
+    }
+    return sets;
+}
+
+// zoox shard-worker <file> <begin> <end> <price part> <error part> [-t tariff file]
+static int run_shard_worker(int argc, char** argv) {
+    if (argc < 7) return 2;
+    TariffTable loaded;
+    const TariffTable* tariffs = &TariffTable::builtin();
+    if (argc > 8 && string_view(argv[7]) == "-t") {
+        string error;
+        if (!TariffTable::load(argv[8], loaded, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+        tariffs = &loaded;
+    }
+    MappedFile file(argv[2]);
+    size_t begin = strtoull(argv[3], nullptr, 10), end = strtoull(argv[4], nullptr, 10);
+    if (!file.ok() || begin > end || end > file.view().size()) return 1;
+    string_view range = file.view().substr(begin, end - begin);
+    vector<LineError> errors;
+    vector<float> costs = process_tickets(range, *tariffs, &errors);
+
+    int fd = open(argv[5], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 1;
+    PriceWriter writer(fd);
+    writer.put(costs, errors);
+    bool ok = writer.flush() && fsync(fd) == 0;
+    close(fd);
+    string report = to_string(count(range.begin(), range.end(), '\n')) + "\n";
+    for (LineError e : errors) report += to_string(e.line) + " " + to_string(int(e.reason)) + "\n";
+    fd = open(argv[6], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = ok && fd >= 0 && write_all(fd, report.data(), report.size());
+    if (fd >= 0) close(fd);
+    return ok ? 0 : 1;
+}
+
+// Runs the workers, joins their parts into out (a descriptor) and the rejected lines into
+// errFd. Part files are named after partPrefix and removed at the end.
+static bool run_shards(const char* path, size_t n, const char* tariffPath, const string& partPrefix, int out,
+                       int errFd, string& error) {
+    constexpr int attempts = 3;
+    MappedFile file(path);
+    if (!file.ok()) {
+        error = string(path) + ": " + strerror(errno);
+        return false;
+    }
+    if (ColumnFile::is_column_file(file.view())) {
+        error = string(path) + ": zoox shard prices text ticket files";
+        return false;
+    }
+    string_view input = file.view();
+    vector<string_view> ranges = split_lines(input, n);
+    vector<cpu_set_t> cpus = worker_cpus(ranges.size());
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len <= 0) {
+        error = string("/proc/self/exe: ") + strerror(errno);
+        return false;
+    }
+    self[len] = '\0';
+
+    auto part = [&](size_t i, const char* kind) { return partPrefix + "." + to_string(i) + "." + kind; };
+    // ZOOX_SHARD_CRASH=<range> makes that range's first worker abort, to try out the retry
+    const char* crash = getenv("ZOOX_SHARD_CRASH");
+    auto launch = [&](size_t i, int attempt) -> pid_t {
+        string begin = to_string(ranges[i].data() - input.data());
+        string end = to_string(ranges[i].data() + ranges[i].size() - input.data());
+        string prices = part(i, "prices"), errors = part(i, "errors");
+        vector<const char*> args{self, "shard-worker", path, begin.c_str(), end.c_str(), prices.c_str(), errors.c_str()};
+        if (tariffPath) args.insert(args.end(), {"-t", tariffPath});
+        args.push_back(nullptr);
+        bool crashNow = crash && attempt == 0 && strtoull(crash, nullptr, 10) == i;
+        pid_t pid = fork();
+        if (pid == 0) {
+            sched_setaffinity(0, sizeof(cpu_set_t), &cpus[i]);
+            if (crashNow) abort();
+            execv(self, const_cast<char**>(args.data()));
+            _exit(127);
+        }
+        return pid;
+    };
+
+    unordered_map<pid_t, size_t> running;
+    vector<int> tries(ranges.size(), 0);
+    bool ok = true;
+    for (size_t i = 0; i < ranges.size() && ok; ++i) {
+        pid_t pid = launch(i, tries[i]++);
+        if (pid < 0) ok = false, error = string("fork: ") + strerror(errno);
+        else running[pid] = i;
+    }
+    while (!running.empty()) {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0 && errno == EINTR) continue;
+        if (pid < 0) break;
+        auto it = running.find(pid);
+        if (it == running.end()) continue;
+        size_t i = it->second;
+        running.erase(it);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+        cerr << "zoox shard: worker for bytes " << ranges[i].data() - input.data() << "+" << ranges[i].size()
+             << (WIFSIGNALED(status) ? " was killed by signal " + to_string(WTERMSIG(status))
+                                     : " exited with " + to_string(WEXITSTATUS(status)))
+             << (ok && tries[i] < attempts ? ", retrying" : "") << endl;
+        if (!ok || tries[i] >= attempts) {
+            if (ok) error = "a worker failed " + to_string(attempts) + " times";
+            ok = false;
+            continue;
+        }
+        pid_t again = launch(i, tries[i]++);
+        if (again < 0) ok = false, error = string("fork: ") + strerror(errno);
+        else running[again] = i;
+    }
+
+    size_t first = 0;  // lines before the current range
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (ok) {
+            MappedFile prices(part(i, "prices").c_str());
+            ifstream errors(part(i, "errors"));
+            size_t lines = 0, line;
+            int reason;
+            errors >> lines;
+            string report;
+            while (errors >> line >> reason) {
+                report += string(path) + ":" + to_string(first + line) + ": " + describe(ParseError(reason)) + "\n";
+            }
+            first += lines;
+            if (!prices.ok() || !write_all(out, prices.view().data(), prices.view().size()) ||
+                !write_all(errFd, report.data(), report.size())) {
+                error = strerror(errno);
+                ok = false;
+            }
+        }
+        unlink(part(i, "prices").c_str());
+        unlink(part(i, "errors").c_str());
+    }
+    return ok;
+}
+
+// Results of pricing a column file, kept next to it so that a tariff change only reprices
+// the airlines it touches. Native byte order:
+//
+//   RepriceHeader
+//   uint64_t fingerprint[airlines]   TariffTable::fingerprint of each airline when last priced
+//   uint64_t first[airlines + 1]     where each airline's tickets start in the index
+//   uint32_t index[tickets]          ticket numbers grouped by airline
+//   float price[tickets]             in ticket order
+//
+// Airlines are numbered as in the column file.
+struct RepriceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t airlines;
+    uint64_t tickets;
+    ColumnHeader columns;  // the column file this belongs to, its content hash included
+    uint64_t fingerprintOffset;
+    uint64_t firstOffset;
+    uint64_t indexOffset;
+    uint64_t priceOffset;
+};
+
+constexpr char repriceMagic[8] = {'Z', 'O', 'O', 'X', 'I', 'N', 'C', '1'};
+
+struct RepriceStats {
+    size_t airlines = 0;  // airlines whose tariff changed
+    size_t tickets = 0;   // tickets priced again
+};
+
+// Prices the tickets of column file that belong to the given airlines (file ids) and stores
+// the prices at their ticket numbers, fetched through the index. Their seat ids are checked
+// on the way, false at the first out of range.
+static bool reprice_airlines(const ColumnFile& file, const TariffTable& tariffs, const vector<uint8_t>& ids,
+                             const vector<size_t>& changed, const uint64_t* first, const uint32_t* index,
+                             float* prices, string& error) {
+    TicketBatch batch;
+    batch.reserve(batchSize);
+    vector<float> out(batchSize);
+    for (size_t airline : changed) {
+        for (uint64_t begin = first[airline]; begin < first[airline + 1]; begin += batchSize) {
+            size_t n = min<uint64_t>(batchSize, first[airline + 1] - begin);
+            batch.clear();
+            for (size_t j = 0; j < n; ++j) {
+                uint32_t t = index[begin + j];
+                if (file.seats()[t] >= SeatCount) {
+                    error = "corrupt column file, ticket " + to_string(t) + " has an id out of range";
+                    return false;
+                }
+                batch.push_back(Ticket{static_cast<Airline>(ids[airline]), static_cast<Seat>(file.seats()[t]),
+                                       file.distances()[t]});
+            }
+            price_batch(tariffs, batch, out.data());
+            for (size_t j = 0; j < n; ++j) prices[index[begin + j]] = out[j];
+        }
+    }
+    return true;
+}
+
+// Brings the state file up to date with tariffs. Without a state file for this column file
+// everything is priced and the state written; with one, only airlines whose fingerprint
+// changed are priced again and their prices patched in place.
+static bool reprice(const ColumnFile& file, const TariffTable& tariffs, const char* statePath,
+                    const ColumnHeader& columns, RepriceStats& stats, string& error) {
+    vector<uint8_t> ids;
+    if (!file.map_airlines(tariffs, ids, error)) return false;
+    if (file.size() > numeric_limits<uint32_t>::max()) {
+        error = "too many tickets for an incremental state";
+        return false;
+    }
+    size_t airlines = file.airline_names().size();
+    RepriceHeader header = {};
+    memcpy(header.magic, repriceMagic, sizeof(repriceMagic));
+    header.version = 3;
+    header.airlines = airlines;
+    header.tickets = file.size();
+    header.columns = columns;
+    header.fingerprintOffset = align64(sizeof(RepriceHeader));
+    header.firstOffset = header.fingerprintOffset + airlines * sizeof(uint64_t);
+    header.indexOffset = align64(header.firstOffset + (airlines + 1) * sizeof(uint64_t));
+    header.priceOffset = align64(header.indexOffset + file.size() * sizeof(uint32_t));
+    size_t size = header.priceOffset + file.size() * sizeof(float);
+
+    int fd = open(statePath, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        error = string(statePath) + ": " + strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    // a state file whose header does not match this column file's, content hash included, is
+    // rebuilt; only then are all ticket ids read
+    bool fresh = size_t(st.st_size) != size;
+    if (!fresh) {
+        RepriceHeader old;
+        fresh = pread(fd, &old, sizeof(old), 0) != ssize_t(sizeof(old)) || memcmp(&old, &header, sizeof(old)) != 0;
+    }
+    if (fresh && !file.check_ids(error)) {
+        close(fd);
+        return false;
+    }
+    void* p = MAP_FAILED;
+    if (!fresh || (ftruncate(fd, 0) == 0 && ftruncate(fd, size) == 0)) {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+        error = string(statePath) + ": " + strerror(errno);
+        return false;
+    }
+    char* base = static_cast<char*>(p);
+    uint64_t* fingerprint = reinterpret_cast<uint64_t*>(base + header.fingerprintOffset);
+    uint64_t* first = reinterpret_cast<uint64_t*>(base + header.firstOffset);
+    uint32_t* index = reinterpret_cast<uint32_t*>(base + header.indexOffset);
+    float* prices = reinterpret_cast<float*>(base + header.priceOffset);
+
+    vector<size_t> changed;
+    if (fresh) {
+        // counting sort of ticket numbers by airline
+        fill(first, first + airlines + 1, 0);
+        const uint8_t* air = file.airlines();
+        for (size_t t = 0; t < file.size(); ++t) ++first[air[t] + 1];
+        for (size_t a = 0; a < airlines; ++a) first[a + 1] += first[a];
+        vector<uint64_t> next(first, first + airlines);
+        for (size_t t = 0; t < file.size(); ++t) index[next[air[t]]++] = t;
+        for (size_t a = 0; a < airlines; ++a) changed.push_back(a);
+    } else {
+        for (size_t a = 0; a < airlines; ++a) {
+            if (fingerprint[a] != tariffs.fingerprint(ids[a])) changed.push_back(a);
+        }
+    }
+    if (!reprice_airlines(file, tariffs, ids, changed, first, index, prices, error)) {
+        munmap(base, size);
+        return false;
+    }
+    for (size_t a : changed) fingerprint[a] = tariffs.fingerprint(ids[a]);
+    // the header goes in last, so a run that dies half way leaves a state that gets rebuilt
+    if (fresh) memcpy(base, &header, sizeof(header));
+
+    stats.airlines = changed.size();
+    stats.tickets = 0;
+    for (size_t a : changed) stats.tickets += first[a + 1] - first[a];
+    bool synced = msync(base, size, MS_SYNC) == 0;
+    if (!synced) error = string(statePath) + ": " + strerror(errno);
+    munmap(base, size);
+    return synced;
+}
+
+// The two parsers this file used to have and the pipeline of zooxcopy.cpp, kept so the
+// benchmark has something to compare to
+namespace reference {
+
+static Ticket parse_ticket(const string& s) {
+    // zoox.cpp: getline into a vector of tokens, then stof
+    vector<string> arr;
+    std::stringstream ss(s);
+    std::string token;
+    while (std::getline(ss, token, ' ') ) {
+        arr.push_back(token);
+    }
+    assert(arr.size()== 3);
+    Ticket ticket;
+    ticket.airline = airlines[arr[0]];
+    ticket.seat = seats[arr[2]];
+    ticket.distance = std::stof(arr[1]);
+    return ticket;
+}
+
+static Ticket parseString(string& s) {
+    // zooxcopy.cpp: operator>> straight into the fields
+    Ticket t;
+    stringstream ss(s);
+    string air;
+    float mile;
+    string lvl;
+    ss >> air >> mile >> lvl;
+    t.airline = airlines[air];
+    t.distance = mile;
+    t.seat = seats[lvl];
+    return t;
+}
+
+// zooxcopy.cpp as it was: its own ticket, name maps and calculator hierarchy, a singleton per
+// airline whose operating cost goes through virtual calls per seat class
+namespace copy {
+
+enum airline {United, Delta, SouthWest, LuigiAir};
+
+enum level {Economy, Premium, Business};
+
+unordered_map<string, airline> stringToAirline{{"United", United},{"Delta", Delta},{"SouthWest", SouthWest},{"LuigiAir", LuigiAir}};
+
+unordered_map<string, level> stringToLevel{{"Economy", Economy},{"Premium", Premium},{"Business", Business}};
+
+struct Ticket {
+    airline air;
+    float mile;
+    level lvl;
+};
+
+class AirlineCalculator {
+    public:
+        static AirlineCalculator* getInstance(const Ticket& ticket);
+        virtual float getTotalCost(const Ticket& ticket) const = 0;
+        virtual ~AirlineCalculator() = default;
+        AirlineCalculator& operator= (const AirlineCalculator& ) = delete;
+        AirlineCalculator(const AirlineCalculator& ) = delete;
+    protected:
+        virtual float getOperationCost(const Ticket& ticket) const {
+            float opCost = 0;
+            switch (ticket.lvl) {
+                case (Economy):
+                    opCost = getEconomyCost(ticket);
+                    break;
+                case (Premium):
+                    opCost = getPremiumCost(ticket);
+                    break;
+                case (Business):
+                    opCost = getBusinessCost(ticket);
+            }
+            return opCost;
+        }
+        virtual float getEconomyCost(const Ticket&) const { return 0.0; }
+        virtual float getPremiumCost(const Ticket&) const { return 25.0; }
+        virtual float getBusinessCost(const Ticket& ticket) const { return 50.0 + 0.25 * ticket.mile; }
+        AirlineCalculator() = default;
+};
+
+class UnitedCalculator : public AirlineCalculator {
+    public:
+        virtual float getTotalCost(const Ticket& ticket) const {
+            float cost = getOperationCost(ticket);
+            return 0.75 * ticket.mile + cost;
+        }
+        static UnitedCalculator* instance() {
+            static UnitedCalculator calc;
+            return &calc;
+        }
+    protected:
+        virtual float getPremiumCost(const Ticket& ticket) const { return 25.0 + 0.1 * ticket.mile; }
+    private:
+        UnitedCalculator() = default;
+};
+
+class DeltaCalculator : public AirlineCalculator {
+    public:
+        virtual float getTotalCost(const Ticket& ticket) const {
+            return (float) (0.5 * ticket.mile) + getOperationCost(ticket);
+        }
+        static DeltaCalculator* instance() {
+            static DeltaCalculator calc;
+            return &calc;
+        }
+    private:
+        DeltaCalculator() = default;
+};
+
+class SouthWestCalculator : public AirlineCalculator {
+    public:
+        virtual float getTotalCost(const Ticket& ticket) const { return 1.0 * ticket.mile; }
+        static SouthWestCalculator* instance() {
+            static SouthWestCalculator calc;
+            return &calc;
+        }
+    private:
+        SouthWestCalculator() = default;
+};
+
+class LuigiAirCalculator : public AirlineCalculator {
+    public:
+        virtual float getTotalCost(const Ticket& ticket) const {
+            return max((float) 100.0, 2 * getOperationCost(ticket));
+        }
+        static LuigiAirCalculator* instance() {
+            static LuigiAirCalculator calc;
+            return &calc;
+        }
+    private:
+        LuigiAirCalculator() = default;
+};
+
+AirlineCalculator* AirlineCalculator::getInstance(const Ticket& ticket) {
+    switch (ticket.air) {
+        case (United):
+            return UnitedCalculator::instance();
+        case (Delta):
+            return DeltaCalculator::instance();
+        case (SouthWest):
+            return SouthWestCalculator::instance();
+        case (LuigiAir):
+            return LuigiAirCalculator::instance();
+    }
+    return nullptr;
+}
+
+static Ticket parseString(string& s) {
+    Ticket t;
+    stringstream ss(s);
+    string air;
+    float mile;
+    string lvl;
+    ss >> air >> mile >> lvl;
+    t.air = stringToAirline[air];
+    t.mile = mile;
+    t.lvl = stringToLevel[lvl];
+    return t;
+}
+
+} // namespace copy
+
+} // namespace reference
+
+// Shape of a synthetic ticket file. Weights are relative, distances are either
+// uniform:<lo>:<hi> or exp:<mean> miles. The same seed gives the same file.
+struct Workload {
+    vector<pair<string, double>> airlines{{"Delta", 1}, {"United", 1}, {"SouthWest", 1}, {"LuigiAir", 1}};
+    vector<pair<string, double>> seats{{"Economy", 6}, {"Premium", 3}, {"Business", 1}};
+    bool exponential = false;
+    double lo = 50, hi = 5000, mean = 1000;
+    uint64_t seed = 1;
+
+    // Reads "Name:weight,Name:weight", false if it does not look like that
+    static bool parse_weights(string_view spec, vector<pair<string, double>>& out) {
+        out.clear();
+        while (!spec.empty()) {
+            size_t comma = min(spec.find(','), spec.size());
+            string_view item = spec.substr(0, comma);
+            spec.remove_prefix(min(comma + 1, spec.size()));
+            size_t colon = item.find(':');
+            double weight = 1;
+            if (colon != string_view::npos) {
+                auto [ptr, ec] = from_chars(item.data() + colon + 1, item.data() + item.size(), weight);
+                if (ec != errc() || ptr != item.data() + item.size() || weight < 0) return false;
+                item = item.substr(0, colon);
+            }
+            if (item.empty()) return false;
+            out.emplace_back(item, weight);
+        }
+        return !out.empty();
+    }
+
+    bool parse_distance(string_view spec) {
+        auto number = [](string_view token, double& value) {
+            auto [ptr, ec] = from_chars(token.data(), token.data() + token.size(), value);
+            return ec == errc() && ptr == token.data() + token.size();
+        };
+        if (spec.substr(0, 4) == "exp:") {
+            exponential = true;
+            return number(spec.substr(4), mean) && mean > 0;
+        }
+        if (spec.substr(0, 8) != "uniform:") return false;
+        spec.remove_prefix(8);
+        size_t colon = spec.find(':');
+        exponential = false;
+        return colon != string_view::npos && number(spec.substr(0, colon), lo) &&
+               number(spec.substr(colon + 1), hi) && lo <= hi;
+    }
+
+    // Options shared by gen and bench, argv[arg] onwards. False on anything it does not know.
+    bool parse_options(int argc, char** argv, int arg) {
+        for (; arg < argc; arg += 2) {
+            string_view opt = argv[arg];
+            if (arg + 1 == argc) return false;
+            string_view value = argv[arg + 1];
+            if (opt == "--seed") seed = strtoull(argv[arg + 1], nullptr, 10);
+            else if (opt == "--airlines") { if (!parse_weights(value, airlines)) return false; }
+            else if (opt == "--seats") { if (!parse_weights(value, seats)) return false; }
+            else if (opt == "--distance") { if (!parse_distance(value)) return false; }
+            else return false;
+        }
+        return true;
+    }
+
+    // Calls f(line) for n generated lines, line is only valid during the call
+    template <typename F>
+    void generate(size_t n, F&& f) const {
+        uint64_t state = seed;
+        // splitmix64, the same numbers on every platform unlike the <random> distributions
+        auto next = [&state] {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        };
+        auto uniform = [&next] { return (next() >> 11) * 0x1.0p-53; };
+        auto cumulative = [](const vector<pair<string, double>>& weights) {
+            vector<double> sums;
+            double total = 0;
+            for (const auto& w : weights) sums.push_back(total += w.second);
+            for (double& v : sums) v /= total;
+            return sums;
+        };
+        vector<double> airlineSums = cumulative(airlines), seatSums = cumulative(seats);
+        auto pick = [&uniform](const vector<double>& sums) {
+            return min<size_t>(upper_bound(sums.begin(), sums.end(), uniform()) - sums.begin(), sums.size() - 1);
+        };
+        char line[256];
+        for (size_t i = 0; i < n; ++i) {
+            const string& airline = airlines[pick(airlineSums)].first;
+            const string& seat = seats[pick(seatSums)].first;
+            double miles = exponential ? -mean * log1p(-uniform()) : lo + (hi - lo) * uniform();
+            int len = snprintf(line, sizeof(line), "%.*s %.1f %.*s", int(min<size_t>(airline.size(), 100)),
+                               airline.data(), miles, int(min<size_t>(seat.size(), 100)), seat.data());
+            f(string_view(line, len));
+        }
+    }
+};
+
+static vector<string> make_sample_lines(size_t n) {
+    vector<string> lines;
+    lines.reserve(n);
+    Workload().generate(n, [&](string_view line) { lines.emplace_back(line); });
+    return lines;
+}
+
+// zoox gen <lines> [workload options]: writes a synthetic ticket file to stdout
+static bool generate_tickets(size_t n, const Workload& workload) {
+    string buffer;
+    buffer.reserve(1 << 20);
+    bool ok = true;
+    workload.generate(n, [&](string_view line) {
+        buffer.append(line);
+        buffer.push_back('\n');
+        if (buffer.size() > (1 << 20) - 256) {
+            ok = ok && write_all(STDOUT_FILENO, buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    });
+    return ok && write_all(STDOUT_FILENO, buffer.data(), buffer.size());
+}
+
+// Seconds per stage of one implementation, negative when it has no such stage
+struct StageTimes {
+    double parse = -1, dispatch = -1, price = -1, format = -1, total = -1;
+};
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// An original pipeline: one string per line, virtual calculators, iostream. dispatch picks a
+// ticket's calculator and price asks it for the cost, so zoox.cpp and zooxcopy.cpp each run
+// with their own hierarchy.
+template <typename Parse, typename Dispatch, typename Price>
+static StageTimes bench_reference(const vector<string_view>& lines, Parse parse, Dispatch dispatch, Price price,
+                                  int sink) {
+    using Parsed = decltype(parse(declval<string&>()));
+    StageTimes t;
+    auto start = chrono::steady_clock::now();
+    vector<Parsed> tickets;
+    for (string_view line : lines) {
+        string s(line);
+        tickets.push_back(parse(s));
+    }
+    t.parse = seconds_since(start);
+    start = chrono::steady_clock::now();
+    vector<decltype(dispatch(declval<const Parsed&>()))> calculators;
+    for (const Parsed& ticket : tickets) calculators.push_back(dispatch(ticket));
+    t.dispatch = seconds_since(start);
+    start = chrono::steady_clock::now();
+    vector<float> costs;
+    for (size_t i = 0; i < tickets.size(); ++i) costs.push_back(price(calculators[i], tickets[i]));
+    t.price = seconds_since(start);
+    start = chrono::steady_clock::now();
+    ostringstream out;
+    out << fixed << setprecision(2);
+    for (float c : costs) out << c << '\n';
+    write_all(sink, out.str().data(), out.str().size());
+    t.format = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    vector<string> input(lines.begin(), lines.end());
+    vector<float> all;
+    for (string& line : input) {
+        Parsed ticket = parse(line);
+        all.push_back(price(dispatch(ticket), ticket));
+    }
+    ostringstream text;
+    text << fixed << setprecision(2);
+    for (float c : all) text << c << '\n';
+    write_all(sink, text.str().data(), text.str().size());
+    t.total = seconds_since(start);
+    return t;
+}
+
+// This file's pipeline: string_view lines into columns, the tariff table kernel, PriceWriter
+static StageTimes bench_batch(string_view input, const vector<string_view>& lines, int sink) {
+    const TariffTable& tariffs = TariffTable::builtin();
+    StageTimes t;
+    auto start = chrono::steady_clock::now();
+    TicketBatch batch;
+    batch.reserve(lines.size());
+    for (string_view line : lines) add_to_batch(tariffs, batch, line);
+    t.parse = seconds_since(start);
+    start = chrono::steady_clock::now();
+    vector<float> costs(batch.size());
+    price_batch(tariffs, batch, costs.data());
+    t.price = seconds_since(start);
+    start = chrono::steady_clock::now();
+    {
+        PriceWriter writer(sink);
+        writer.put(costs);
+    }
+    t.format = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    PriceWriter writer(sink);
+    writer.put(process_tickets(input, tariffs));
+    writer.flush();
+    t.total = seconds_since(start);
+    return t;
+}
+
+// Parser plus the compile time PolicyRegistry, one ticket at a time
+static StageTimes bench_registry(const vector<string_view>& lines, int sink) {
+    StageTimes t;
+    auto start = chrono::steady_clock::now();
+    vector<Ticket> tickets(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) parse_ticket(lines[i], tickets[i]);
+    t.parse = seconds_since(start);
+    start = chrono::steady_clock::now();
+    vector<float> costs(tickets.size());
+    for (size_t i = 0; i < tickets.size(); ++i) costs[i] = Airlines::price(tickets[i]);
+    t.price = seconds_since(start);
+    start = chrono::steady_clock::now();
+    {
+        PriceWriter writer(sink);
+        writer.put(costs);
+    }
+    t.format = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    PriceWriter writer(sink);
+    for (string_view line : lines) {
+        Ticket ticket;
+        parse_ticket(line, ticket);
+        writer.put(Airlines::price(ticket));
+    }
+    writer.flush();
+    t.total = seconds_since(start);
+    return t;
+}
+
+// A "Field:  123 kB" line of /proc/self/status in kB, -1 if it is not there
+static long status_kb(const char* field) {
+    ifstream status("/proc/self/status");
+    string key;
+    long kb;
+    while (status >> key) {
+        if (key.size() == strlen(field) + 1 && key.compare(0, key.size() - 1, field) == 0 && status >> kb) return kb;
+        status.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+    return -1;
+}
+
+// zoox bench [lines] [workload options]: every implementation over the same generated input.
+// Each one runs in its own child process, which starts out with the input it shares with
+// the parent already resident. The peak RSS column is how far each one grew past that.
+static void bench_suite(size_t n, const Workload& workload) {
+    string input;
+    workload.generate(n, [&](string_view line) {
+        input.append(line);
+        input.push_back('\n');
+    });
+    vector<string_view> lines;
+    lines.reserve(n);
+    for_each_line(input, [&](string_view line, size_t, size_t) {
+        if (!line.empty()) lines.push_back(line);
+    });
+    int sink = open("/dev/null", O_WRONLY);
+
+    struct Implementation {
+        const char* name;
+        function<StageTimes()> run;
+    };
+    vector<Implementation> implementations = {
+        {"zoox.cpp original", [&] {
+             return bench_reference(
+                 lines, [](string& s) { return reference::parse_ticket(s); },
+                 [](const Ticket& t) { return AirlineCalculator::create(t.airline); },
+                 [](AirlineCalculator* c, const Ticket& t) { return c->calculate(t); }, sink);
+         }},
+        {"zooxcopy.cpp original", [&] {
+             namespace copy = reference::copy;
+             return bench_reference(
+                 lines, [](string& s) { return copy::parseString(s); },
+                 [](const copy::Ticket& t) { return copy::AirlineCalculator::getInstance(t); },
+                 [](copy::AirlineCalculator* c, const copy::Ticket& t) { return c->getTotalCost(t); }, sink);
+         }},
+        {"batch + tariff table", [&] { return bench_batch(input, lines, sink); }},
+        {"PolicyRegistry", [&] { return bench_registry(lines, sink); }},
+    };
+
+    cout << n << " lines, " << fixed << setprecision(1) << input.size() / 1e6 << " MB, seed " << workload.seed << endl;
+    cout << left << setw(24) << "implementation" << setw(12) << "stage" << right << setw(14) << "lines/s"
+         << setw(12) << "ns/line" << setw(14) << "+RSS MB" << endl;
+    struct Result {
+        StageTimes times;
+        double grownMB;
+    };
+    for (const Implementation& impl : implementations) {
+        int fds[2];
+        if (pipe(fds) != 0) return;
+        pid_t child = fork();
+        if (child == 0) {
+            // "5" resets VmHWM to what is resident now, kernels without it keep the parent's peak
+            ofstream("/proc/self/clear_refs") << "5";
+            long baseline = status_kb("VmRSS");
+            Result r;
+            r.times = impl.run();
+            r.grownMB = (status_kb("VmHWM") - baseline) / 1024.0;
+            write_all(fds[1], reinterpret_cast<const char*>(&r), sizeof(r));
+            _exit(0);
+        }
+        close(fds[1]);
+        Result r;
+        bool got = read(fds[0], &r, sizeof(r)) == ssize_t(sizeof(r));
+        close(fds[0]);
+        int status;
+        waitpid(child, &status, 0);
+        const StageTimes& t = r.times;
+        if (!got) {
+            cout << left << setw(24) << impl.name << "failed" << endl;
+            continue;
+        }
+        pair<const char*, double> stages[] = {{"parse", t.parse}, {"dispatch", t.dispatch}, {"price", t.price},
+                                              {"format", t.format}, {"end-to-end", t.total}};
+        for (auto [stage, secs] : stages) {
+            if (secs < 0) continue;
+            cout << left << setw(24) << impl.name << setw(12) << stage << right << fixed << setprecision(0)
+                 << setw(14) << n / max(secs, 1e-9) << setprecision(2) << setw(12) << secs * 1e9 / max<size_t>(n, 1);
+            if (stage == string_view("end-to-end")) cout << setprecision(1) << setw(14) << r.grownMB;
+            cout << endl;
+        }
+    }
+    close(sink);
+}
+
+// zoox bench-parse [lines]: lines per second for each parser over the same input
+static void bench_parsers(size_t n) {
+    vector<string> lines = make_sample_lines(n);
+    auto run = [&](const char* name, auto&& parse) {
+        double sink = 0;
+        auto start = chrono::steady_clock::now();
+        for (string& line : lines) sink += parse(line).distance;
+        chrono::duration<double> secs = chrono::steady_clock::now() - start;
+        cout << left << setw(24) << name << right << setw(14) << fixed << setprecision(0)
+             << n / secs.count() << " lines/s  (checksum " << sink << ")" << endl;
+    };
+    run("stringstream+getline", [](string& line) { return reference::parse_ticket(line); });
+    run("stringstream+operator>>", [](string& line) { return reference::parseString(line); });
+    run("single pass+switch", [](string& line) {
+        Ticket ticket;
+        parse_ticket(line, ticket);
+        return ticket;
+    });
+}
+
+// zoox bench-dispatch [tickets]: virtual calculators against the compile time registry
+static void bench_dispatch(size_t n) {
+    vector<Ticket> tickets;
+    tickets.reserve(n);
+    for (string& line : make_sample_lines(n)) {
+        Ticket ticket;
+        parse_ticket(line, ticket);
+        tickets.push_back(ticket);
+    }
+    vector<float> virtualCosts(n), registryCosts(n);
+    auto run = [&](const char* name, vector<float>& out, auto&& price) {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) out[i] = price(tickets[i]);
+        chrono::duration<double> secs = chrono::steady_clock::now() - start;
+        cout << left << setw(24) << name << right << setw(14) << fixed << setprecision(0)
+             << n / secs.count() << " tickets/s  " << setprecision(2) << secs.count() * 1e9 / n << " ns/ticket" << endl;
+    };
+    run("create + calculate", virtualCosts, [](const Ticket& t) { return AirlineCalculator::create(t.airline)->calculate(t); });
+    run("PolicyRegistry", registryCosts, [](const Ticket& t) { return Airlines::price(t); });
+    cout << (virtualCosts == registryCosts ? "same prices" : "PRICES DIFFER") << endl;
+}
+
+// zoox bench-price [tickets]: the pricing step alone, on tickets that are already parsed
+static void bench_pricing(size_t n) {
+    TicketBatch batch;
+    batch.reserve(n);
+    vector<Ticket> tickets;
+    for (string& line : make_sample_lines(n)) {
+        Ticket ticket;
+        parse_ticket(line, ticket);
+        tickets.push_back(ticket);
+        batch.push_back(ticket);
+    }
+    vector<float> out(n);
+    auto run = [&](const char* name, auto&& price) {
+        auto start = chrono::steady_clock::now();
+        price();
+        chrono::duration<double> secs = chrono::steady_clock::now() - start;
+        double sink = 0;
+        for (float c : out) sink += c;
+        cout << left << setw(24) << name << right << setw(14) << fixed << setprecision(0)
+             << n / secs.count() << " tickets/s  (checksum " << sink << ")" << endl;
+    };
+    run("virtual calculate", [&] {
+        for (size_t i = 0; i < n; ++i) out[i] = AirlineCalculator::create(tickets[i].airline)->calculate(tickets[i]);
+    });
+    run("batch scalar", [&] {
+        price_batch_scalar(TariffTable::builtin().data(), batch.distance.data(), batch.airline.data(), batch.seat.data(), n,
+                           out.data());
+    });
+    run("batch simd", [&] { price_batch(TariffTable::builtin(), batch, out.data()); });
+
+    // the same four airlines written as formulas, so every ticket goes through the interpreter
+    istringstream text("formula Delta 0.5 * miles + op\n"
+                       "formula United 0.75 * miles + op + if(premium, 0.1 * miles, 0)\n"
+                       "formula SouthWest miles\n"
+                       "formula LuigiAir max(100, 2 * op)\n");
+    TariffTable formulas;
+    string error;
+    TariffTable::load(text, "formulas", formulas, error);
+    run("batch formulas", [&] { price_batch(formulas, batch, out.data()); });
+
+    // the integer engine, the checksum is in dollars like the ones above
+    CentsTable table;
+    CentsTable::from(TariffTable::builtin(), table, error);
+    CentsBatch cents;
+    cents.reserve(n);
+    for (string& line : make_sample_lines(n)) add_to_batch(TariffTable::builtin(), cents, line);
+    vector<int64_t> centsOut(n);
+    auto runCents = [&](const char* name, auto&& price) {
+        auto start = chrono::steady_clock::now();
+        price();
+        chrono::duration<double> secs = chrono::steady_clock::now() - start;
+        int64_t sink = 0;
+        for (int64_t c : centsOut) sink += c;
+        cout << left << setw(24) << name << right << setw(14) << fixed << setprecision(0)
+             << n / secs.count() << " tickets/s  (checksum " << sink / 100 << ")" << endl;
+    };
+    runCents("cents scalar", [&] {
+        price_cents_scalar(table.data(), cents.distance.data(), cents.airline.data(), cents.seat.data(), n,
+                           centsOut.data());
+    });
+    runCents("cents simd", [&] { price_batch(table, cents, centsOut.data()); });
+}
+
+// Request latencies in whole microseconds, everything from 100 ms up shares the last bucket
+class LatencyHistogram {
+public:
+    static constexpr size_t buckets = 100000;
+
+    LatencyHistogram() : counts(buckets + 1) {}
+
+    void record(uint64_t nanoseconds) {
+        ++counts[min<uint64_t>(nanoseconds / 1000, buckets)];
+        ++total;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i <= buckets; ++i) counts[i] += other.counts[i];
+        total += other.total;
+    }
+
+    size_t size() const { return total; }
+
+    // Microseconds within which fraction q of the requests were answered
+    uint64_t percentile(double q) const {
+        uint64_t rank = ceil(q * total), seen = 0;
+        for (size_t i = 0; i <= buckets; ++i) {
+            seen += counts[i];
+            if (seen >= rank && seen > 0) return i;
+        }
+        return buckets;
+    }
+
+    void report(ostream& out) const {
+        out << total << " requests, p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p99.9 "
+            << percentile(0.999) << " us" << endl;
+    }
+
+private:
+    vector<uint64_t> counts;
+    uint64_t total = 0;
+};
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Prices ticket lines sent over a Unix domain socket, one answer line per request line in
+// request order: the price ("152.50") or "error: <reason>". One thread runs an epoll loop;
+// the lines that arrive on all connections in one wakeup are priced as one batch.
+class PriceServer {
+public:
+    explicit PriceServer(const TariffTable& tariffs) : tariffs(tariffs) {}
+    PriceServer(const PriceServer&) = delete;
+    void operator=(const PriceServer&) = delete;
+
+    ~PriceServer() {
+        for (auto& [fd, connection] : connections) close(fd);
+        if (listener >= 0) {
+            close(listener);
+            unlink(path.c_str());
+        }
+        if (signals >= 0) close(signals);
+        if (poll >= 0) close(poll);
+    }
+
+    bool listen(const char* socketPath, string& error) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (strlen(socketPath) >= sizeof(address.sun_path)) {
+            error = string(socketPath) + ": path too long for a socket";
+            return false;
+        }
+        strcpy(address.sun_path, socketPath);
+        unlink(socketPath);
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0) {
+            error = string(socketPath) + ": " + strerror(errno);
+            return false;
+        }
+        path = socketPath;
+        return true;
+    }
+
+    // Serves until SIGINT or SIGTERM. SIGUSR1 prints the latencies so far to stderr.
+    bool run(string& error) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        sigaddset(&mask, SIGUSR1);
+        sigprocmask(SIG_BLOCK, &mask, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+        signals = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        poll = epoll_create1(EPOLL_CLOEXEC);
+        if (signals < 0 || poll < 0 || !watch(listener, EPOLLIN, EPOLL_CTL_ADD) || !watch(signals, EPOLLIN, EPOLL_CTL_ADD)) {
+            error = strerror(errno);
+            return false;
+        }
+        batch.reserve(batchSize);
+        epoll_event events[256];
+        for (bool stop = false; !stop;) {
+            int n = epoll_wait(poll, events, 256, -1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                error = strerror(errno);
+                return false;
+            }
+            uint64_t arrived = now_ns();
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listener) accept_all();
+                else if (fd == signals) stop = take_signals();
+                else serve(fd, events[i].events, arrived);
+            }
+            answer();
+            for (int fd : finished) finish(fd);
+            finished.clear();
+        }
+        return true;
+    }
+
+    const LatencyHistogram& latencies() const { return histogram; }
+
+private:
+    static constexpr size_t maxLine = 4096;
+    static constexpr size_t maxBacklog = 1 << 20;  // unsent answers before a connection stops being read
+
+    struct Connection {
+        string in;
+        string out;
+        size_t sent = 0;
+        bool closing = false;  // failed, close it now
+        bool eof = false;      // the peer is done sending, close it once every answer is out
+        uint32_t watching = EPOLLIN;
+    };
+
+    // A request line waiting for its answer: its index in the batch, or why it was rejected
+    struct Pending {
+        int fd;
+        uint32_t index;
+        ParseError error;
+        uint64_t arrived;
+    };
+
+    bool watch(int fd, uint32_t events, int op) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(poll, op, fd, &event) == 0;
+    }
+
+    void accept_all() {
+        for (;;) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            if (!watch(fd, EPOLLIN, EPOLL_CTL_ADD)) {
+                close(fd);
+                continue;
+            }
+            connections[fd];
+        }
+    }
+
+    bool take_signals() {
+        bool stop = false;
+        signalfd_siginfo info;
+        while (read(signals, &info, sizeof(info)) == sizeof(info)) {
+            if (info.ssi_signo == SIGUSR1) histogram.report(cerr);
+            else stop = true;
+        }
+        return stop;
+    }
+
+    void serve(int fd, uint32_t events, uint64_t arrived) {
+        Connection& c = connections[fd];
+        if (events & EPOLLOUT) send_out(fd, c);
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            char buffer[65536];
+            ssize_t got = read(fd, buffer, sizeof(buffer));
+            if (got > 0) c.in.append(buffer, got);
+            else if (got == 0) c.eof = true;
+            else if (errno != EAGAIN) c.closing = true;
+        }
+        size_t begin = 0;
+        for (size_t end; (end = c.in.find('\n', begin)) != string::npos; begin = end + 1) {
+            string_view line(c.in.data() + begin, end - begin);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            ParseError error = add_to_batch(tariffs, batch, line);
+            pending.push_back(Pending{fd, uint32_t(batch.size() - 1), error, arrived});
+            if (batch.size() == batchSize) answer();
+        }
+        c.in.erase(0, begin);
+        if (c.in.size() > maxLine) c.closing = true;
+        if (c.closing || c.eof) finished.push_back(fd);
+    }
+
+    // Prices the batch and queues every pending answer on its connection
+    void answer() {
+        if (pending.empty()) return;
+        costs.resize(batch.size());
+        price_batch(tariffs, batch, costs.data());
+        char price[PriceWriter::maxPrice + 1];
+        for (const Pending& p : pending) {
+            Connection& c = connections[p.fd];
+            if (p.error == ParseError::None) {
+                char* end = format_price(costs[p.index], price);
+                *end++ = '\n';
+                c.out.append(price, end);
+            } else {
+                c.out += "error: ";
+                c.out += describe(p.error);
+                c.out += '\n';
+            }
+        }
+        for (const Pending& p : pending) {
+            Connection& c = connections[p.fd];
+            if (c.sent < c.out.size()) send_out(p.fd, c);
+        }
+        uint64_t done = now_ns();
+        for (const Pending& p : pending) histogram.record(done - p.arrived);
+        pending.clear();
+        batch.clear();
+    }
+
+    void send_out(int fd, Connection& c) {
+        while (c.sent < c.out.size()) {
+            ssize_t n = send(fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+            if (n > 0) c.sent += n;
+            else if (n < 0 && errno == EINTR) continue;
+            else {
+                if (errno != EAGAIN) c.closing = true, finished.push_back(fd);
+                break;
+            }
+        }
+        if (c.sent == c.out.size()) {
+            c.out.clear();
+            c.sent = 0;
+            if (c.eof) finished.push_back(fd);
+        }
+        rewatch(fd, c);
+    }
+
+    // A client that does not read its answers is not read from either, nor one that is done sending
+    void rewatch(int fd, Connection& c) {
+        bool reading = !c.eof && c.out.size() - c.sent < maxBacklog;
+        uint32_t want = (reading ? uint32_t(EPOLLIN) : 0) | (c.out.empty() ? 0 : uint32_t(EPOLLOUT));
+        if (want != c.watching && watch(fd, want, EPOLL_CTL_MOD)) c.watching = want;
+    }
+
+    // Closes a connection that failed, or one whose peer is done sending once its answers are
+    // out; until then it is only watched for room to send them, and send_out finishes it
+    void finish(int fd) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) return;
+        Connection& c = it->second;
+        if (!c.closing && !c.out.empty()) {
+            rewatch(fd, c);
+            return;
+        }
+        close(fd);
+        connections.erase(it);
+    }
+
+    const TariffTable& tariffs;
+    string path;
+    int listener = -1;
+    int signals = -1;
+    int poll = -1;
+    unordered_map<int, Connection> connections;
+    vector<int> finished;
+    TicketBatch batch;
+    vector<Pending> pending;
+    vector<float> costs;
+    LatencyHistogram histogram;
+};
+
+// zoox loadgen: connections threads, each keeping depth requests in flight on its own
+// connection until requests answers came back; latency is from send to answer
+static bool run_loadgen(const char* socketPath, size_t connections, size_t requests, size_t depth,
+                        const Workload& workload) {
+    vector<LatencyHistogram> histograms(connections);
+    atomic<bool> failed{false};
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (size_t t = 0; t < connections; ++t) {
+        threads.emplace_back([&, t] {
+            Workload mine = workload;
+            mine.seed = workload.seed + t;
+            vector<string> lines;
+            mine.generate(min<size_t>(requests, 65536), [&](string_view line) { lines.emplace_back(line); });
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                perror(socketPath);
+                failed = true;
+                if (fd >= 0) close(fd);
+                return;
+            }
+            deque<uint64_t> sentAt;
+            string in;
+            char buffer[65536];
+            size_t sent = 0, answered = 0;
+            while (answered < requests) {
+                string out;
+                for (; sent < requests && sent - answered < depth; ++sent) {
+                    out += lines[sent % lines.size()];
+                    out += '\n';
+                    sentAt.push_back(now_ns());
+                }
+                if (!out.empty() && !write_all(fd, out.data(), out.size())) break;
+                ssize_t got = read(fd, buffer, sizeof(buffer));
+                if (got <= 0) break;
+                uint64_t now = now_ns();
+                for (ssize_t i = 0; i < got; ++i) {
+                    if (buffer[i] != '\n') continue;
+                    histograms[t].record(now - sentAt.front());
+                    sentAt.pop_front();
+                    ++answered;
+                }
+            }
+            if (answered < requests) failed = true;
+            close(fd);
+        });
+    }
+    for (thread& t : threads) t.join();
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+    LatencyHistogram total;
+    for (const LatencyHistogram& h : histograms) total.merge(h);
+    cout << fixed << setprecision(0) << total.size() / secs.count() << " requests/s over " << connections
+         << " connections, depth " << depth << ": ";
+    total.report(cout);
+    return !failed;
+}
+
+// zoox bench-cheapest [queries]: cheapest airline per (distance, seat) query by pricing
+// every airline against the CarrierIndex, on the built-in airlines and on 64 made up ones
+static void bench_cheapest(size_t n) {
+    string text;
+    uint64_t state = 1;
+    auto next = [&state](int range) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return int((state >> 33) % range);
+    };
+    for (int i = 0; i < 64; ++i) {
+        text += "airline Air" + to_string(i) + " miles=0." + to_string(10 + next(90)) + " op=1 add=" +
+                to_string(next(80)) + " min=" + to_string(next(150)) + (next(2) ? " max=" + to_string(800 + next(4000)) : "") + "\n";
+    }
+    text += "formula Luigi64 max(100, 2 * op)\n";
+    istringstream source(text);
+    TariffTable made;
+    string error;
+    if (!TariffTable::load(source, "bench", made, error)) {
+        cerr << error << endl;
+        return;
+    }
+
+    vector<float> miles(n);
+    vector<uint8_t> seats(n);
+    for (size_t i = 0; i < n; ++i) {
+        miles[i] = next(800000) / 100.f;
+        seats[i] = next(SeatCount);
+    }
+    vector<CarrierIndex::Quote> quotes(n);
+    for (const TariffTable* tariffs : {&TariffTable::builtin(), static_cast<const TariffTable*>(&made)}) {
+        vector<uint8_t> all(n);
+        TicketBatch batch;
+        vector<float> price(n), best(n, numeric_limits<float>::infinity());
+        auto start = chrono::steady_clock::now();
+        // every airline for every query, one batch per airline
+        for (size_t id = 0; id < tariffs->size(); ++id) {
+            fill(all.begin(), all.end(), id);
+            price_batch(*tariffs, TicketColumns(miles.data(), all.data(), seats.data(), n), price.data());
+            for (size_t i = 0; i < n; ++i) best[i] = min(best[i], price[i]);
+        }
+        double brute = seconds_since(start);
+        start = chrono::steady_clock::now();
+        CarrierIndex index(*tariffs);
+        double build = seconds_since(start);
+        start = chrono::steady_clock::now();
+        index.cheapest(miles.data(), seats.data(), n, quotes.data());
+        double indexed = seconds_since(start);
+        size_t wrong = 0;
+        for (size_t i = 0; i < n; ++i) wrong += quotes[i].price != best[i];
+        cout << tariffs->size() << " airlines, " << index.intervals(Economy) + index.intervals(Premium) +
+                index.intervals(Business) << " intervals, built in " << fixed << setprecision(3) << build * 1000
+             << " ms" << endl;
+        cout << "  every airline " << setprecision(0) << setw(12) << n / brute << " queries/s" << endl;
+        cout << "  index         " << setw(12) << n / indexed << " queries/s, " << wrong << " disagree" << endl;
+    }
+}
+
+#if ZOOX_COUNT_ALLOCATIONS
+// zoox check-allocs [lines]: runs every pricing path on n and on 2n generated lines and
+// prints how many more allocations the second run made per extra line. A per-line
+// allocation shows as 1 or more; buffers that grow a few more times on the longer run
+// stay far below the 0.001 the check fails at. Only in a -DZOOX_COUNT_ALLOCATIONS=1 build.
+static bool check_allocations(size_t n) {
+    vector<string> lines = make_sample_lines(2 * n);
+    string text[2];
+    for (size_t i = 0; i < 2 * n; ++i) {
+        text[i / n] += lines[i];
+        text[i / n] += '\n';
+    }
+    text[1] = text[0] + text[1];
+    vector<string> vectors[2] = {vector<string>(lines.begin(), lines.begin() + n), lines};
+
+    istringstream source("formula Delta 0.5 * miles + op\n"
+                         "formula United 0.75 * miles + op + if(premium, 0.1 * miles, 0)\n"
+                         "formula SouthWest miles\n"
+                         "formula LuigiAir max(100, 2 * op)\n");
+    TariffTable formulas;
+    CentsTable cents;
+    string error;
+    if (!TariffTable::load(source, "formulas", formulas, error) || !CentsTable::from(TariffTable::builtin(), cents, error)) {
+        cerr << error << endl;
+        return false;
+    }
+    char path[] = "/tmp/zoox-allocs-XXXXXX";
+    int tmp = mkstemp(path);
+    int null = open("/dev/null", O_WRONLY);
+    if (tmp < 0 || null < 0) {
+        perror("check-allocs");
+        return false;
+    }
+    unlink(path);
+
+    bool ok = true;
+    auto check = [&](const char* name, auto&& run) {
+        run(0);  // warms up thread locals and arenas
+        uint64_t counts[2];
+        for (int i = 0; i < 2; ++i) {
+            uint64_t before = allocations;
+            run(i);
+            counts[i] = allocations - before;
+        }
+        double perLine = (double(counts[1]) - double(counts[0])) / n;
+        cout << left << setw(24) << name << right << setw(8) << counts[0] << setw(8) << counts[1] << "  " << fixed
+             << setprecision(4) << perLine << " per line" << endl;
+        ok = ok && perLine < 0.001;
+    };
+    cout << left << setw(24) << "path" << right << setw(8) << "n" << setw(8) << "2n" << endl;
+    check("virtual calculate", [&](int i) { process_tickets(vectors[i]); });
+    check("batch", [&](int i) { process_tickets(text[i]); });
+    check("batch formulas", [&](int i) { process_tickets(text[i], formulas); });
+    check("batch cents", [&](int i) { process_tickets_cents(text[i], cents); });
+    check("stream", [&](int i) {
+        if (ftruncate(tmp, 0) != 0 || pwrite(tmp, text[i].data(), text[i].size(), 0) != ssize_t(text[i].size()) ||
+            lseek(tmp, 0, SEEK_SET) != 0) {
+            perror("check-allocs");
+        }
+        stream_tickets(tmp, null, STDERR_FILENO, "stream", TariffTable::builtin());
+    });
+    close(tmp);
+    close(null);
+    return ok;
+}
+#endif
+
+// zoox check-lines: prices a file of good, rejected and empty lines through every text path
+// and checks that output line N answers input line N, with "error: <reason>" for a rejected one.
+// Distances in every form from_chars knows are among them, so the float and the cents
+// engine are checked to reject the same ones, and distances below a hundredth of a mile
+// to price the same, which they do not if the cents engine rounds the distance before the
+// price. The lines are repeated so that the pool and the shards split them into several pieces.
+static bool check_lines() {
+    const char* lines[] = {"Delta 100 Economy", "", "Delta abc Economy", "United 150.0 Premium",
+                           "Nowhere 10 Economy", "SouthWest 1000.0 Economy", "Delta nan Economy",
+                           "LuigiAir 50.0 Business", "Delta 60.0", "Delta -1 Economy", "United 120.0 Business",
+                           "Delta 60.0 Coach", "", "SouthWest 4000.0 Economy", "Delta 1e3 Economy",
+                           "Delta -0 Economy", "Delta +5 Economy", "Delta .5 Economy", "United 7. Premium",
+                           "Delta 0x10 Economy", "Delta 4294967 Economy", "Delta 4294968 Economy",
+                           "Delta 0.005 Economy", "Delta 0.015 Business", "Delta 2.0049 Economy"};
+    constexpr size_t repeats = 20000;
+    const TariffTable& tariffs = TariffTable::builtin();
+    string block, answers;
+    char price[PriceWriter::maxPrice + 1];
+    for (const char* line : lines) {
+        block += line;
+        block += '\n';
+        float cost;
+        ParseError error = price_ticket(line, cost);
+        if (error == ParseError::None) answers.append(price, format_price(cost, price));
+        else answers += string("error: ") + describe(error);
+        answers += '\n';
+    }
+    string text, expected;
+    for (size_t i = 0; i < repeats; ++i) {
+        text += block;
+        expected += answers;
+    }
+
+    char in[] = "/tmp/zoox-lines-XXXXXX", out[] = "/tmp/zoox-lines-out-XXXXXX";
+    int inFd = mkstemp(in), outFd = mkstemp(out), null = open("/dev/null", O_WRONLY);
+    CentsTable cents;
+    string error;
+    if (inFd < 0 || outFd < 0 || null < 0 || !write_all(inFd, text.data(), text.size())) {
+        perror("check-lines");
+        return false;
+    }
+    if (!CentsTable::from(tariffs, cents, error)) {
+        cerr << error << endl;
+        return false;
+    }
+    MappedFile file(in);
+    ThreadPool pool(4);
+
+    bool ok = true;
+    auto check = [&](const char* name, auto&& run) {
+        if (ftruncate(outFd, 0) != 0 || lseek(outFd, 0, SEEK_SET) != 0) perror("check-lines");
+        run(outFd);
+        string got(expected.size() + 1, '\0');
+        got.resize(max<ssize_t>(pread(outFd, got.data(), got.size(), 0), 0));
+        size_t lineCount = count(got.begin(), got.end(), '\n');
+        cout << left << setw(12) << name << lineCount << " lines, "
+             << (got == expected ? "aligned" : "MISALIGNED") << endl;
+        ok = ok && got == expected;
+    };
+    auto put = [](int fd, const auto& costs, const vector<LineError>& errors) {
+        PriceWriter writer(fd);
+        writer.put(costs, errors);
+    };
+    check("batch", [&](int fd) {
+        vector<LineError> errors;
+        vector<float> costs = process_tickets(file, tariffs, &errors);
+        put(fd, costs, errors);
+    });
+    check("threads", [&](int fd) {
+        vector<LineError> errors;
+        vector<float> costs = process_tickets(file.view(), pool, tariffs, &errors);
+        put(fd, costs, errors);
+    });
+    check("cents", [&](int fd) {
+        vector<LineError> errors;
+        vector<int64_t> costs = process_tickets_cents(file, cents, &errors);
+        put(fd, costs, errors);
+    });
+    check("cents -j", [&](int fd) {
+        vector<LineError> errors;
+        vector<int64_t> costs = process_tickets_cents(file.view(), pool, cents, &errors);
+        put(fd, costs, errors);
+    });
+    check("stream", [&](int fd) {
+        if (lseek(inFd, 0, SEEK_SET) != 0) perror("check-lines");
+        stream_tickets(inFd, fd, null, in, tariffs);
+    });
+    check("shard", [&](int fd) {
+        string shardError;
+        if (!run_shards(in, 3, nullptr, string(out) + ".part", fd, null, shardError)) cerr << shardError << endl;
+    });
+    check("strings", [&](int fd) {
+        vector<string> tickets;
+        for (size_t i = 0; i < repeats; ++i) tickets.insert(tickets.end(), begin(lines), end(lines));
+        vector<LineError> errors;
+        vector<float> costs = process_tickets(tickets, &errors);
+        PriceWriter writer(fd);
+        for (size_t i = 0, e = 0; i < costs.size(); ++i) {
+            if (e < errors.size() && errors[e].line == i + 1) writer.put_error(errors[e++].reason);
+            else writer.put(costs[i]);
+        }
+    });
+    close(inFd);
+    close(outFd);
+    close(null);
+    unlink(in);
+    unlink(out);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 2 && (string_view(argv[1]) == "gen" || string_view(argv[1]) == "bench")) {
+        // zoox gen|bench <lines> [--seed n] [--airlines Name:w,...] [--seats Name:w,...]
+        //                        [--distance uniform:lo:hi|exp:mean]
+        Workload workload;
+        if (!workload.parse_options(argc, argv, 3)) {
+            cerr << "usage: zoox gen|bench <lines> [--seed n] [--airlines Name:w,...] [--seats Name:w,...] "
+                    "[--distance uniform:lo:hi|exp:mean]" << endl;
+            return 1;
+        }
+        size_t n = strtoull(argv[2], nullptr, 10);
+        if (string_view(argv[1]) == "bench") {
+            bench_suite(n, workload);
+            return 0;
+        }
+        if (!generate_tickets(n, workload)) {
+            perror("stdout");
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 3 && string_view(argv[1]) == "convert") {
+        // zoox convert <tickets file> <column file> [-t tariff file] [--no-stats]: writes the
+        // tickets as a column file, which zoox then prices without parsing
+        TariffTable loaded;
+        const TariffTable* tariffs = &TariffTable::builtin();
+        bool stats = true;
+        for (int arg = 4; arg < argc; ++arg) {
+            string error;
+            if (string_view(argv[arg]) == "--no-stats") {
+                stats = false;
+            } else if (string_view(argv[arg]) == "-t" && arg + 1 < argc) {
+                if (!TariffTable::load(argv[++arg], loaded, error)) {
+                    cerr << error << endl;
+                    return 1;
+                }
+                tariffs = &loaded;
+            } else {
+                cerr << "usage: zoox convert <tickets file> <column file> [-t tariff file] [--no-stats]" << endl;
+                return 1;
+            }
+        }
+        MappedFile file(argv[2]);
+        if (!file.ok()) {
+            perror(argv[2]);
+            return 1;
+        }
+        vector<LineError> errors;
+        string error;
+        if (!write_columns(file.view(), *tariffs, argv[3], stats, errors, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+        for (LineError e : errors) cerr << argv[2] << ":" << e.line << ": " << describe(e.reason) << "\n";
+        return 0;
+    }
+    if (argc > 4 && string_view(argv[1]) == "reprice") {
+        // zoox reprice <column file> <tariff file> <state file> [-o output file]: keeps the
+        // prices of a column file in the state file and, when run again after the tariff file
+        // changed, prices only the airlines whose tariffs differ
+        MappedFile file(argv[2]);
+        if (!file.ok()) {
+            perror(argv[2]);
+            return 1;
+        }
+        TariffTable tariffs;
+        ColumnFile columns;
+        RepriceStats stats;
+        string error;
+        ColumnHeader header;
+        if (!TariffTable::load(argv[3], tariffs, error) || !columns.open(file.view(), error, false)) {
+            cerr << error << endl;
+            return 1;
+        }
+        memcpy(&header, file.view().data(), sizeof(header));
+        auto start = chrono::steady_clock::now();
+        if (!reprice(columns, tariffs, argv[4], header, stats, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+        cerr << "repriced " << stats.tickets << " of " << columns.size() << " tickets, " << stats.airlines
+             << " airlines changed, " << fixed << setprecision(3) << seconds_since(start) << " s" << endl;
+        if (argc > 6 && string_view(argv[5]) == "-o") {
+            MappedFile state(argv[4]);
+            RepriceHeader stored;
+            memcpy(&stored, state.view().data(), sizeof(stored));
+            const float* prices = reinterpret_cast<const float*>(state.view().data() + stored.priceOffset);
+            int fd = open(argv[6], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                perror(argv[6]);
+                return 1;
+            }
+            PriceWriter writer(fd);
+            for (size_t i = 0; i < stored.tickets; ++i) writer.put(prices[i]);
+            bool ok = writer.flush();
+            close(fd);
+            if (!ok) {
+                perror(argv[6]);
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if (argc > 2 && string_view(argv[1]) == "serve") {
+        // zoox serve <socket> [-t tariff file]: answers ticket lines sent to the socket until
+        // SIGINT or SIGTERM, then prints the request latencies, as SIGUSR1 does at any time
+        TariffTable loaded;
+        const TariffTable* tariffs = &TariffTable::builtin();
+        string error;
+        if (argc > 4 && string_view(argv[3]) == "-t") {
+            if (!TariffTable::load(argv[4], loaded, error)) {
+                cerr << error << endl;
+                return 1;
+            }
+            tariffs = &loaded;
+        }
+        PriceServer server(*tariffs);
+        if (!server.listen(argv[2], error) || !server.run(error)) {
+            cerr << error << endl;
+            return 1;
+        }
+        server.latencies().report(cerr);
+        return 0;
+    }
+    if (argc > 2 && string_view(argv[1]) == "loadgen") {
+        // zoox loadgen <socket> [--connections n] [--requests n] [--depth n] [workload options]
+        size_t connections = 4, requests = 100000, depth = 16;
+        vector<char*> rest{argv[0]};
+        for (int arg = 3; arg + 1 < argc; arg += 2) {
+            string_view opt = argv[arg];
+            if (opt == "--connections") connections = max<size_t>(1, strtoull(argv[arg + 1], nullptr, 10));
+            else if (opt == "--requests") requests = strtoull(argv[arg + 1], nullptr, 10);
+            else if (opt == "--depth") depth = max<size_t>(1, strtoull(argv[arg + 1], nullptr, 10));
+            else rest.insert(rest.end(), {argv[arg], argv[arg + 1]});
+        }
+        Workload workload;
+        if ((argc - 3) % 2 != 0 || !workload.parse_options(rest.size(), rest.data(), 1)) {
+            cerr << "usage: zoox loadgen <socket> [--connections n] [--requests n] [--depth n] [--seed n] "
+                    "[--airlines Name:w,...] [--seats Name:w,...] [--distance uniform:lo:hi|exp:mean]" << endl;
+            return 1;
+        }
+        return run_loadgen(argv[2], connections, requests, depth, workload) ? 0 : 1;
+    }
+    if (argc > 1 && string_view(argv[1]) == "bench-parse") {
+        bench_parsers(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string_view(argv[1]) == "bench-dispatch") {
+        bench_dispatch(argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && string_view(argv[1]) == "shard-worker") {
+        return run_shard_worker(argc, argv);
+    }
+    if (argc > 3 && string_view(argv[1]) == "shard") {
+        // zoox shard <workers> [-t tariff file] [-o output file] [--errors file] <tickets file>:
+        // the same output as zoox <tickets file>, priced by worker processes, see run_shards
+        size_t workers = strtoull(argv[2], nullptr, 10);
+        if (workers == 0) workers = thread::hardware_concurrency();
+        const char* tariffPath = nullptr;
+        const char* output = nullptr;
+        const char* errorsPath = nullptr;
+        int arg = 3;
+        for (; arg + 2 < argc; arg += 2) {
+            string_view opt = argv[arg];
+            if (opt == "-t") tariffPath = argv[arg + 1];
+            else if (opt == "-o") output = argv[arg + 1];
+            else if (opt == "--errors") errorsPath = argv[arg + 1];
+            else break;
+        }
+        int fd = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+        int errFd = errorsPath ? open(errorsPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDERR_FILENO;
+        if (fd < 0 || errFd < 0) {
+            perror(fd < 0 ? output : errorsPath);
+            return 1;
+        }
+        // parts go next to a regular output file, anywhere else they go to $TMPDIR
+        struct stat st;
+        const char* tmp = getenv("TMPDIR");
+        string prefix = output && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+                            ? string(output)
+                            : string(tmp && *tmp ? tmp : "/tmp") + "/zoox-shard-" + to_string(getpid());
+        string error;
+        if (!run_shards(argv[arg], workers, tariffPath, prefix, fd, errFd, error)) {
+            cerr << "zoox shard: " << error << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 3 && string_view(argv[1]) == "cheapest") {
+        // zoox cheapest [-t tariff file] [-k count] <seat> <miles>: the count (default 3)
+        // cheapest airlines for that trip, cheapest first
+        TariffTable loaded;
+        const TariffTable* tariffs = &TariffTable::builtin();
+        size_t k = 3;
+        int arg = 2;
+        for (; arg + 2 < argc; arg += 2) {
+            string_view opt = argv[arg];
+            if (opt == "-k") {
+                k = strtoul(argv[arg + 1], nullptr, 10);
+            } else if (opt == "-t") {
+                string error;
+                if (!TariffTable::load(argv[arg + 1], loaded, error)) {
+                    cerr << error << endl;
+                    return 1;
+                }
+                tariffs = &loaded;
+            } else {
+                break;
+            }
+        }
+        Seat seat;
+        float miles;
+        if (arg + 2 != argc || !parse_seat(argv[arg], seat) || !parse_distance(argv[arg + 1], miles)) {
+            cerr << "usage: zoox cheapest [-t tariff file] [-k count] <seat> <miles>" << endl;
+            return 1;
+        }
+        CarrierIndex index(*tariffs);
+        CarrierIndex::Quote quotes[CarrierIndex::maxK];
+        size_t found = index.top(seat, miles, k, quotes);
+        char price[PriceWriter::maxPrice + 1];
+        for (size_t i = 0; i < found; ++i) {
+            *format_price(quotes[i].price, price) = '\0';
+            cout << tariffs->name(quotes[i].airline) << " " << price << endl;
+        }
+        return 0;
+    }
+    if (argc > 1 && string_view(argv[1]) == "bench-cheapest") {
+        bench_cheapest(argc > 2 ? strtoul(argv[2], nullptr, 10) : 4000000);
+        return 0;
+    }
+    if (argc > 1 && string_view(argv[1]) == "check-lines") {
+        return check_lines() ? 0 : 1;
+    }
+    if (argc > 1 && string_view(argv[1]) == "check-allocs") {
+#if ZOOX_COUNT_ALLOCATIONS
+        return check_allocations(argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000) ? 0 : 1;
+#else
+        cerr << "nothing is counted, build with -DZOOX_COUNT_ALLOCATIONS=1" << endl;
+        return 1;
+#endif
+    }
+    if (argc > 1 && string_view(argv[1]) == "bench-price") {
+        bench_pricing(argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000000);
+        return 0;
+    }
+    if (argc > 1) {
+        // zoox [-j threads] [-t tariff file] [-o output file] <tickets file>: one ticket per
+        // line, one cost per line. -j 0 uses every core, without -j the file is priced on this
+        // thread. Without -t the four airlines of the problem statement are priced. Without -o
+        // the costs go to stdout. --telemetry writes per stage timings and ticket counts as
+        // JSON to a file ("-" for stderr) at exit and whenever the process gets SIGUSR1.
+        // Lines that do not parse get "error: <reason>" in place of a cost, and their numbers
+        // and the reasons also go to stderr, or to the file given with --errors. A column file
+        // written by zoox convert is priced straight from its columns. --engine cents prices
+        // text files in integer cents instead of float, see CentsTable; distances with more
+        // than three decimals are rounded to the thousandth of a mile there first. "-" or a
+        // pipe is priced as it streams in, see stream_tickets; -j and --engine do not apply
+        // there.
+        unsigned threads = 1;
+        bool cents = false;
+        const char* errorsPath = nullptr;
+        const char* output = nullptr;
+        const char* telemetry = nullptr;
+        TariffTable loaded;
+        const TariffTable* tariffs = &TariffTable::builtin();
+        int arg = 1;
+        for (; arg + 2 < argc; arg += 2) {
+            string_view opt = argv[arg];
+            if (opt == "-j") {
+                threads = strtoul(argv[arg + 1], nullptr, 10);
+                if (threads == 0) threads = thread::hardware_concurrency();
+            } else if (opt == "-t") {
+                string error;
+                if (!TariffTable::load(argv[arg + 1], loaded, error)) {
+                    cerr << error << endl;
+                    return 1;
+                }
+                tariffs = &loaded;
+            } else if (opt == "-o") {
+                output = argv[arg + 1];
+            } else if (opt == "--telemetry") {
+                telemetry = argv[arg + 1];
+            } else if (opt == "--errors") {
+                errorsPath = argv[arg + 1];
+            } else if (opt == "--engine") {
+                cents = string_view(argv[arg + 1]) == "cents";
+                if (!cents && string_view(argv[arg + 1]) != "float") {
+                    cerr << "--engine is float or cents" << endl;
+                    return 1;
+                }
+            } else {
+                break;
+            }
+        }
+        auto dump_telemetry = [&] {
+            auto names = [tariffs](size_t id) { return id < tariffs->size() ? tariffs->name(id) : to_string(id); };
+            if (string_view(telemetry) == "-") {
+                Telemetry::dump(cerr, names);
+                return;
+            }
+            ofstream out(telemetry);
+            Telemetry::dump(out, names);
+        };
+        if (telemetry) {
+            // SIGUSR1 is blocked before any worker starts, so only this thread ever takes it
+            sigset_t usr1;
+            sigemptyset(&usr1);
+            sigaddset(&usr1, SIGUSR1);
+            pthread_sigmask(SIG_BLOCK, &usr1, nullptr);
+            thread([usr1, dump_telemetry] {
+                for (int sig; sigwait(&usr1, &sig) == 0;) dump_telemetry();
+            }).detach();
+            Telemetry::enable();
+        }
+        struct stat st;
+        bool streamed = string_view(argv[arg]) == "-" || (stat(argv[arg], &st) == 0 && !S_ISREG(st.st_mode));
+        if (streamed) {
+            int in = string_view(argv[arg]) == "-" ? STDIN_FILENO : open(argv[arg], O_RDONLY);
+            int errFd = errorsPath ? open(errorsPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDERR_FILENO;
+            int fd = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+            if (in < 0 || errFd < 0 || fd < 0) {
+                perror(in < 0 ? argv[arg] : errFd < 0 ? errorsPath : output);
+                return 1;
+            }
+            bool ok = stream_tickets(in, fd, errFd, argv[arg], *tariffs);
+            if (!ok) perror(argv[arg]);
+            if (telemetry) dump_telemetry();
+            return ok ? 0 : 1;
+        }
+        MappedFile file(argv[arg]);
+        if (!file.ok()) {
+            perror(argv[arg]);
+            return 1;
+        }
+        vector<float> costs;
+        vector<int64_t> centCosts;
+        vector<LineError> errors;
+        if (cents) {
+            // column files hold float distances already, there is nothing exact left to price
+            CentsTable table;
+            string error;
+            if (ColumnFile::is_column_file(file.view())) error = "--engine cents needs a text ticket file";
+            if (!error.empty() || !CentsTable::from(*tariffs, table, error)) {
+                cerr << argv[arg] << ": " << error << endl;
+                return 1;
+            }
+            if (threads > 1) {
+                ThreadPool pool(threads);
+                centCosts = process_tickets_cents(file.view(), pool, table, &errors);
+            } else {
+                centCosts = process_tickets_cents(file, table, &errors);
+            }
+        } else if (ColumnFile::is_column_file(file.view())) {
+            // written by zoox convert, nothing to parse
+            ColumnFile columns;
+            string error;
+            unique_ptr<ThreadPool> pool = threads > 1 ? make_unique<ThreadPool>(threads) : nullptr;
+            if (!columns.open(file.view(), error) || !process_columns(columns, *tariffs, pool.get(), costs, error)) {
+                cerr << argv[arg] << ": " << error << endl;
+                return 1;
+            }
+        } else if (threads > 1) {
+            ThreadPool pool(threads);
+            costs = process_tickets(file.view(), pool, *tariffs, &errors);
+        } else {
+            costs = process_tickets(file, *tariffs, &errors);
+        }
+        if (!errors.empty()) {
+            int errFd = errorsPath ? open(errorsPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDERR_FILENO;
+            if (errFd < 0) {
+                perror(errorsPath);
+                return 1;
+            }
+            string report;
+            for (LineError e : errors) {
+                report += argv[arg];
+                report += ":" + to_string(e.line) + ": " + describe(e.reason) + "\n";
+            }
+            write_all(errFd, report.data(), report.size());
+            if (errorsPath) close(errFd);
+        }
+        int fd = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+        if (fd < 0) {
+            perror(output);
+            return 1;
+        }
+        PriceWriter writer(fd);
+        if (cents) writer.put(centCosts, errors);
+        else writer.put(costs, errors);
+        if (!writer.flush()) {
+            perror(output ? output : "stdout");
+            return 1;
+        }
+        if (output) close(fd);
+        if (telemetry) dump_telemetry();
+        return 0;
+    }
+    vector<string> input{"United 150.0 Premium", "United 120.0 Economy","United 100.0 Business","Delta 60.0 Economy","Delta 60.0 Premium","Delta 60.0 Business", "SouthWest 1000.0 Economy", "SouthWest 4000.0 Economy", "LuigiAir 50.0 Business"};
+    vector<LineError> errors;
+    vector<float> costs = process_tickets(input, &errors);
+    for(size_t i = 0, e = 0; i < input.size(); i++){
+        if (e < errors.size() && errors[e].line == i + 1) cout << input[i] << " error: " << describe(errors[e++].reason) << endl;
+        else cout << input[i] << " cost: $" << costs[i]<< endl;
     }
     return 0;
 }
\ No newline at end of file
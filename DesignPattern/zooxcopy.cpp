@@ -58,7 +58,9 @@ Explanation of Output:
 #include <algorithm>
 #include <vector>
 #include <string>
-#include <sstream>
+#include <string_view>
+#include <charconv>
+#include <cmath>
 
 using namespace std;
 
@@ -66,9 +68,15 @@ enum airline {United, Delta, SouthWest, LuigiAir};
 
 enum level {Economy, Premium, Business};
 
-unordered_map<string, airline> stringToAirline{{"United", United},{"Delta", Delta},{"SouthWest", SouthWest},{"LuigiAir", LuigiAir}};
+// hashes string_view too, so a lookup by a token does not build a string
+struct NameHash {
+    using is_transparent = void;
+    size_t operator()(string_view s) const { return hash<string_view>{}(s); }
+};
+
+unordered_map<string, airline, NameHash, equal_to<>> stringToAirline{{"United", United},{"Delta", Delta},{"SouthWest", SouthWest},{"LuigiAir", LuigiAir}};
 
-unordered_map<string, level> stringToLevel{{"Economy", Economy},{"Premium", Premium},{"Business", Business}};
+unordered_map<string, level, NameHash, equal_to<>> stringToLevel{{"Economy", Economy},{"Premium", Premium},{"Business", Business}};
 
 
 
@@ -217,17 +225,49 @@ AirlineCalculator* AirlineCalculator::getInstance(const Ticket& ticket) {
 }
 
 
-Ticket parseString(string& s) {
-    Ticket t;
-    stringstream ss(s);
-    string air;
+// Cuts the next blank separated token off the front of s
+string_view nextToken(string_view& s) {
+    size_t begin = s.find_first_not_of(' ');
+    if (begin == string_view::npos) begin = s.size();
+    size_t end = min(s.find(' ', begin), s.size());
+    string_view token = s.substr(begin, end - begin);
+    s.remove_prefix(end);
+    return token;
+}
+
+// Why parseString rejected a line
+enum class ParseError { None, Fields, Airline, Distance, Seat };
+
+const char* describe(ParseError error) {
+    switch (error) {
+        case ParseError::None: return "ok";
+        case ParseError::Fields: return "expected <airline> <distance> <seat>";
+        case ParseError::Airline: return "unknown airline";
+        case ParseError::Distance: return "distance is not a non-negative number";
+        case ParseError::Seat: return "unknown seat class";
+    }
+    return "?";
+}
+
+// Rejects a line that is not "<airline> <miles> <seat>" with known names and a finite,
+// non-negative distance. find instead of operator[] so an unknown name is not quietly added
+// to the map as United/Economy. The tokens are views into s, nothing is allocated.
+ParseError parseString(string_view s, Ticket& t) {
+    string_view air = nextToken(s);
+    string_view miles = nextToken(s);
+    string_view lvl = nextToken(s);
+    if (lvl.empty() || !nextToken(s).empty()) return ParseError::Fields;
+    auto a = stringToAirline.find(air);
+    if (a == stringToAirline.end()) return ParseError::Airline;
     float mile;
-    string lvl;
-    ss >> air >> mile >> lvl;
-    t.air = stringToAirline[air];
+    auto [end, ec] = from_chars(miles.data(), miles.data() + miles.size(), mile);
+    if (ec != errc() || end != miles.data() + miles.size() || !isfinite(mile) || mile < 0) return ParseError::Distance;
+    auto l = stringToLevel.find(lvl);
+    if (l == stringToLevel.end()) return ParseError::Seat;
+    t.air = a->second;
     t.mile = mile;
-    t.lvl = stringToLevel[lvl];
-    return t;
+    t.lvl = l->second;
+    return ParseError::None;
 }
 
 
@@ -235,15 +275,17 @@ Ticket parseString(string& s) {
 
 
 int main() {
-    vector<string> input{"United 150.0 Premium", "United 120.0 Economy","United 100.0 Business","Delta 60.0 Economy","Delta 60.0 Premium","Delta 60.0 Business", "SouthWest 1000.0 Economy", "SouthWest 4000.0 Economy"};
-    vector<float> output;
-    for (string& s : input) {
-        Ticket ticket = parseString(s);
+    vector<string> input{"United 150.0 Premium", "United 120.0 Economy","United 100.0 Business","Delta 60.0 Economy","Delta 60.0 Premium","Delta 60.0 Business", "SouthWest 1000.0 Economy", "SouthWest 4000.0 Economy", "Delta nan Economy", "Delta inf Economy"};
+    for (size_t i = 0; i < input.size(); ++i) {
+        Ticket ticket;
+        ParseError error = parseString(input[i], ticket);
+        if (error != ParseError::None) {
+            // rejected lines go to stderr with their line number and why, the rest keep going
+            cerr << "line " << i + 1 << ": " << describe(error) << ": \"" << input[i] << "\"" << endl;
+            continue;
+        }
         AirlineCalculator* clc = AirlineCalculator::getInstance(ticket);
-        output.push_back(clc->getTotalCost(ticket));
-    }
-    for (int i = 0; i < output.size(); ++i) {
-        cout << input[i] << " costs " << output[i] <<endl; 
+        cout << input[i] << " costs " << clc->getTotalCost(ticket) <<endl; 
     }
 
 